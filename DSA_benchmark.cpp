@@ -0,0 +1,225 @@
+// ============= EXPENSE MANAGER BENCHMARKS =============
+// Google Benchmark suite over synthetic ledgers from WorkloadGenerator.
+//
+// Build:  g++ -std=c++17 -O2 -pthread DSA_benchmark.cpp -lbenchmark -o expense_bench
+// Run:    ./expense_bench [--benchmark_filter=Search] [--benchmark_format=json]
+//
+// Ledgers run from 10K rows up to EXPENSE_BENCH_MAX_ROWS (default 1M; set
+// it to 100000000 for the full range). Every benchmark reports items/s plus
+// p50 / p99 / p99.9 latency and heap allocations per operation.
+#define EXPENSE_NO_MAIN
+#define EXPENSE_NO_WORKLOAD_MAIN
+#define EXPENSE_COUNT_ALLOCS
+#include "DSA_workload.cpp"
+
+#include <benchmark/benchmark.h>
+#include <type_traits>
+
+// ============= HARNESS =============
+// Runs op once per iteration, timing each call on its own. setup, if
+// given, runs before every op with the benchmark clock paused.
+template <typename F, typename Setup = nullptr_t>
+void measure(benchmark::State& state, F op, Setup setup = nullptr) {
+    LatencyRecorder latency;
+    AllocationStats before = allocationStats();
+    for (auto _ : state) {
+        if constexpr (!is_same<Setup, nullptr_t>::value) {
+            state.PauseTiming();
+            setup();
+            state.ResumeTiming();
+        }
+        auto start = chrono::steady_clock::now();
+        op();
+        auto end = chrono::steady_clock::now();
+        latency.record(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+    }
+    AllocationStats after = allocationStats();
+    double iterations = (double)max<benchmark::IterationCount>(1, state.iterations());
+    state.SetItemsProcessed(state.iterations());
+    state.counters["p50_ns"] = latency.percentile(50);
+    state.counters["p99_ns"] = latency.percentile(99);
+    state.counters["p999_ns"] = latency.percentile(99.9);
+    state.counters["allocs/op"] = (after.count - before.count) / iterations;
+    state.counters["bytes/op"] = (after.bytes - before.bytes) / iterations;
+}
+
+// Read-only benchmarks share one ledger per size; sizes run one at a time,
+// so only the current size is kept in memory.
+static ExpenseManager& sharedLedger(size_t rows) {
+    static unique_ptr<ExpenseManager> ledger;
+    static size_t ledgerRows = 0;
+    if (!ledger || ledgerRows != rows) {
+        QuietOutput quiet;
+        ledger.reset();
+        ledger.reset(new ExpenseManager());
+        WorkloadGenerator(42).fill(*ledger, rows);
+        ledger->setHistoryLimit(1);
+        ledgerRows = rows;
+    }
+    return *ledger;
+}
+
+// Mutating benchmarks get a private copy of the same ledger
+static unique_ptr<ExpenseManager> freshLedger(size_t rows) {
+    QuietOutput quiet;
+    unique_ptr<ExpenseManager> ledger(new ExpenseManager());
+    WorkloadGenerator(42).fill(*ledger, rows);
+    return ledger;
+}
+
+// ============= MUTATIONS =============
+static void BM_Add(benchmark::State& state) {
+    auto ledger = freshLedger(state.range(0));
+    ledger->setHistoryLimit(1);
+    WorkloadGenerator gen(7);
+    QuietOutput quiet;
+    measure(state, [&] {
+        Transaction t = gen.row();
+        ledger->addTransaction(t.date, t.category, t.amount, t.description, t.type);
+    });
+}
+
+static void BM_Delete(benchmark::State& state) {
+    size_t rows = state.range(0);
+    auto ledger = freshLedger(rows);
+    ledger->setHistoryLimit(1);
+    vector<int> order(rows);
+    for (size_t i = 0; i < rows; ++i) order[i] = (int)i + 1;
+    shuffle(order.begin(), order.end(), mt19937(3));
+    size_t next = 0;
+    QuietOutput quiet;
+    measure(state, [&] { ledger->deleteTransaction(order[next++]); }, [&] {
+        if (next < rows) return;
+        // Every row is gone: start over on a new ledger
+        ledger = freshLedger(rows);
+        ledger->setHistoryLimit(1);
+        next = 0;
+    });
+}
+
+static void BM_Update(benchmark::State& state) {
+    size_t rows = state.range(0);
+    auto ledger = freshLedger(rows);
+    ledger->setHistoryLimit(1);
+    mt19937 rng(5);
+    QuietOutput quiet;
+    measure(state, [&] {
+        TransactionUpdate change;
+        change.hasAmount = true;
+        change.amount = (double)(rng() % 100000) / 100;
+        ledger->updateTransaction(1 + (int)(rng() % rows), change);
+    });
+}
+
+static void BM_Undo(benchmark::State& state) {
+    size_t rows = state.range(0);
+    auto ledger = freshLedger(rows);
+    ledger->setHistoryLimit(1);
+    mt19937 rng(11);
+    QuietOutput quiet;
+    // Undo of a delete; the delete itself is not timed
+    measure(state, [&] { ledger->undo(); }, [&] {
+        ledger->deleteTransaction(1 + (int)(rng() % rows));
+    });
+}
+
+// ============= QUERIES =============
+static void BM_ShowByCategory(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    // A tail category, so the result stays small at every size
+    measure(state, [&] { ledger.showByCategory("Charity"); });
+}
+
+static void BM_SearchByDateRange(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.searchByDateRange({1, 3, 2024}, {3, 3, 2024}); });
+}
+
+static void BM_SearchByAmountRange(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.searchByAmountRange(5000, 5100); });
+}
+
+static void BM_SearchByKeyword(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.searchByKeyword("Flight #7"); });
+}
+
+static void BM_PlannedQuery(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    Query q;
+    q.category = "Travel";
+    q.hasAmountRange = true;
+    q.minAmount = 1000;
+    q.maxAmount = 2000;
+    measure(state, [&] { benchmark::DoNotOptimize(ledger.query(q)); });
+}
+
+static void BM_QueryPage(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    Query q;
+    q.category = "Food";
+    PageRequest req;
+    req.limit = 50;
+    req.order = BY_DATE;
+    measure(state, [&] { benchmark::DoNotOptimize(ledger.queryPage(q, req)); });
+}
+
+static void BM_TopExpenses(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.showTopExpenses(10); });
+}
+
+static void BM_MonthlyTotal(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    measure(state, [&] { benchmark::DoNotOptimize(ledger.getMonthlyTotal(6, 2024, "Expense")); });
+}
+
+static void BM_CategorySummary(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.showCategorySummary(); });
+}
+
+static void BM_Statistics(benchmark::State& state) {
+    ExpenseManager& ledger = sharedLedger(state.range(0));
+    QuietOutput quiet;
+    measure(state, [&] { ledger.showStatistics(); });
+}
+
+// ============= REGISTRATION =============
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+
+    size_t maxRows = 1000000;
+    if (const char* env = getenv("EXPENSE_BENCH_MAX_ROWS")) maxRows = strtoull(env, nullptr, 10);
+
+    struct Entry {
+        const char* name;
+        void (*fn)(benchmark::State&);
+    };
+    const Entry entries[] = {
+        {"Add", BM_Add}, {"Delete", BM_Delete}, {"Update", BM_Update}, {"Undo", BM_Undo},
+        {"ShowByCategory", BM_ShowByCategory}, {"SearchByDateRange", BM_SearchByDateRange},
+        {"SearchByAmountRange", BM_SearchByAmountRange}, {"SearchByKeyword", BM_SearchByKeyword},
+        {"PlannedQuery", BM_PlannedQuery}, {"QueryPage", BM_QueryPage},
+        {"TopExpenses", BM_TopExpenses}, {"MonthlyTotal", BM_MonthlyTotal},
+        {"CategorySummary", BM_CategorySummary}, {"Statistics", BM_Statistics},
+    };
+
+    // Size-major order keeps a single shared ledger alive at a time
+    for (size_t rows = 10000; rows <= maxRows; rows *= 10) {
+        for (const Entry& e : entries) {
+            benchmark::RegisterBenchmark(e.name, e.fn)->Arg((int64_t)rows)->Unit(benchmark::kMicrosecond);
+        }
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,14 +1,101 @@
 #include <iostream>
 #include <vector>
 #include <unordered_map>
+#include <map>
+#include <set>
 #include <stack>
+#include <deque>
+#include <climits>
 #include <string>
 #include <iomanip>
 #include <algorithm>
 #include <ctime>
+#include <charconv>
+#include <string_view>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <memory_resource>
+#include <unordered_set>
+#include <list>
+#include <queue>
+#include <cmath>
+#include <condition_variable>
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define EXPENSE_HAS_IO_URING 1
+#endif
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
 
 using namespace std;
 
+// ============= ALLOCATION COUNTERS =============
+// Build with -DEXPENSE_COUNT_ALLOCS to count every global operator new; used
+// to check that the steady-state add path does not touch malloc.
+struct AllocationStats {
+    size_t count;
+    size_t bytes;
+};
+
+#ifdef EXPENSE_COUNT_ALLOCS
+static atomic<size_t> g_allocCount{0}, g_allocBytes{0};
+
+static void* countedAlloc(size_t n, size_t align) {
+    g_allocCount.fetch_add(1, memory_order_relaxed);
+    g_allocBytes.fetch_add(n, memory_order_relaxed);
+    void* p = align > alignof(max_align_t) ? aligned_alloc(align, (n + align - 1) / align * align)
+                                           : malloc(n ? n : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void* operator new(size_t n) { return countedAlloc(n, 0); }
+void* operator new[](size_t n) { return countedAlloc(n, 0); }
+void* operator new(size_t n, align_val_t a) { return countedAlloc(n, (size_t)a); }
+void* operator new[](size_t n, align_val_t a) { return countedAlloc(n, (size_t)a); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, align_val_t) noexcept { free(p); }
+
+AllocationStats allocationStats() {
+    return {g_allocCount.load(memory_order_relaxed), g_allocBytes.load(memory_order_relaxed)};
+}
+#else
+AllocationStats allocationStats() {
+    return {0, 0};
+}
+#endif
+
 // ============= DATE STRUCTURE =============
 struct Date {
     int day, month, year;
@@ -22,16 +109,112 @@ struct Date {
     bool operator>=(const Date& other) const {
         return other <= *this;
     }
+
+    // Sortable integer key (YYYYMMDD) used by the date index
+    int key() const {
+        return year * 10000 + month * 100 + day;
+    }
+
+    // Month bucket used by the date histogram
+    int monthKey() const {
+        return year * 12 + (month - 1);
+    }
+
+    static Date fromKey(int key) {
+        return {key % 100, key / 100 % 100, key / 10000};
+    }
+
+    bool isValid() const {
+        static const int daysIn[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        if (year < 1900 || year > 9999 || month < 1 || month > 12 || day < 1) return false;
+        bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return day <= (month == 2 && !leap ? 28 : daysIn[month - 1]);
+    }
+};
+
+// ============= COUNTING MEMORY RESOURCE =============
+// Upstream for the string arena and the node pools; tracks the bytes they
+// currently hold so the memory report sees slack the containers can't.
+class CountingResource : public pmr::memory_resource {
+private:
+    pmr::memory_resource* upstream;
+    size_t held;
+
+    void* do_allocate(size_t n, size_t align) override {
+        void* p = upstream->allocate(n, align);
+        held += n;
+        return p;
+    }
+
+    void do_deallocate(void* p, size_t n, size_t align) override {
+        upstream->deallocate(p, n, align);
+        held -= n;
+    }
+
+    bool do_is_equal(const pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    CountingResource() : upstream(pmr::new_delete_resource()), held(0) {}
+
+    size_t bytesHeld() const { return held; }
+};
+
+// ============= STRING ARENA =============
+// Monotonic bump allocator for transaction strings. Views it hands out stay
+// valid until release(); categories and types are interned so each distinct
+// value is stored once.
+class StringArena {
+private:
+    CountingResource upstream;
+    pmr::monotonic_buffer_resource buffer;
+    unordered_set<string_view> interned;
+    size_t bytes;
+
+public:
+    StringArena() : buffer(1 << 16, &upstream), bytes(0) {}
+    StringArena(const StringArena&) = delete;
+    StringArena& operator=(const StringArena&) = delete;
+
+    string_view copy(string_view s) {
+        if (s.empty()) return string_view();
+        char* p = static_cast<char*>(buffer.allocate(s.size(), 1));
+        memcpy(p, s.data(), s.size());
+        bytes += s.size();
+        return string_view(p, s.size());
+    }
+
+    string_view intern(string_view s) {
+        auto it = interned.find(s);
+        if (it != interned.end()) return *it;
+        string_view stored = copy(s);
+        interned.insert(stored);
+        return stored;
+    }
+
+    size_t bytesUsed() const { return bytes; }
+    size_t bytesReserved() const { return upstream.bytesHeld(); }
+    size_t internedCount() const { return interned.size(); }
+    size_t internedBucketCount() const { return interned.bucket_count(); }
+
+    void release() {
+        interned.clear();
+        buffer.release();
+        bytes = 0;
+    }
 };
 
 // ============= TRANSACTION STRUCTURE =============
+// String fields are views into the owning ExpenseManager's arena (or a
+// mapped snapshot), so a Transaction is trivially copyable.
 struct Transaction {
     int id;
     Date date;
-    string category;
+    string_view category;
     double amount;
-    string description;
-    string type; // "Income" or "Expense"
+    string_view description;
+    string_view type; // "Income" or "Expense"
     
     // For sorting
     bool operator<(const Transaction& other) const {
@@ -39,103 +222,5196 @@ struct Transaction {
     }
 };
 
+// Amounts are finite and non-negative: a NaN would break the ordering of the
+// amount index, zone maps and view min/max, and an infinity every total
+inline bool validAmount(double amount) {
+    return isfinite(amount) && amount >= 0;
+}
+
+// ============= UPDATE FIELDS =============
+// Changes for updateTransaction(); unset fields keep their current value.
+struct TransactionUpdate {
+    bool hasDate = false;
+    Date date{};
+    bool hasAmount = false;
+    double amount = 0;
+    string category;             // empty = unchanged
+    bool hasDescription = false;
+    string description;
+    string type;                 // empty = unchanged
+};
+
+// ============= BUFFERED REPORT WRITER =============
+// Formats rows into a reusable buffer with to_chars and writes it out in
+// large blocks. Columns are left-aligned and padded like setw(), counting
+// bytes, so output matches the iostream version without per-row allocations.
+class ReportWriter {
+private:
+    ostream& out;
+    vector<char> buffer;
+    size_t used;
+
+    void reserve(size_t n) {
+        if (used + n > buffer.size()) {
+            flush();
+            if (n > buffer.size()) buffer.resize(n);
+        }
+    }
+
+    void pad(size_t written, int width) {
+        if (width <= 0 || written >= (size_t)width) return;
+        size_t fill = width - written;
+        reserve(fill);
+        fill_n(buffer.data() + used, fill, ' ');
+        used += fill;
+    }
+
+public:
+    explicit ReportWriter(ostream& os = cout, size_t capacity = 1 << 16)
+        : out(os), buffer(capacity), used(0) {}
+
+    ~ReportWriter() { flush(); }
+
+    ReportWriter& text(string_view s, int width = 0) {
+        reserve(s.size());
+        copy(s.begin(), s.end(), buffer.data() + used);
+        used += s.size();
+        pad(s.size(), width);
+        return *this;
+    }
+
+    ReportWriter& integer(long long v, int width = 0) {
+        reserve(24);
+        char* end = to_chars(buffer.data() + used, buffer.data() + used + 24, v).ptr;
+        size_t n = end - (buffer.data() + used);
+        used += n;
+        pad(n, width);
+        return *this;
+    }
+
+    // Fixed-point with the given number of decimals
+    ReportWriter& number(double v, int precision, int width = 0) {
+        reserve(352);
+        char* start = buffer.data() + used;
+        char* end = to_chars(start, start + 352, v, chars_format::fixed, precision).ptr;
+        size_t n = end - start;
+        used += n;
+        pad(n, width);
+        return *this;
+    }
+
+    // "₹" followed by six decimals, matching "₹" + to_string(amount)
+    ReportWriter& amount(double v, int width = 0) {
+        const string_view rupee = "₹";
+        reserve(rupee.size() + 352);
+        char* start = buffer.data() + used;
+        copy(rupee.begin(), rupee.end(), start);
+        char* end = to_chars(start + rupee.size(), start + rupee.size() + 352,
+                             v, chars_format::fixed, 6).ptr;
+        size_t n = end - start;
+        used += n;
+        pad(n, width);
+        return *this;
+    }
+
+    // d/m/yyyy without zero padding
+    ReportWriter& date(const Date& d, int width = 0) {
+        reserve(40);
+        char* start = buffer.data() + used;
+        char* p = to_chars(start, start + 12, d.day).ptr;
+        *p++ = '/';
+        p = to_chars(p, p + 12, d.month).ptr;
+        *p++ = '/';
+        p = to_chars(p, p + 12, d.year).ptr;
+        size_t n = p - start;
+        used += n;
+        pad(n, width);
+        return *this;
+    }
+
+    ReportWriter& newline() {
+        reserve(1);
+        buffer[used++] = '\n';
+        return *this;
+    }
+
+    void flush() {
+        if (used == 0) return;
+        out.write(buffer.data(), used);
+        used = 0;
+    }
+};
+
 // ============= UNDO OPERATION STRUCTURE =============
-enum OpType { ADD, DELETE_OP };
+enum OpType { ADD, DELETE_OP, GROUP_BEGIN, GROUP_END, UPDATE };
 
+// Only the id is kept: an ADD is undone by tombstoning that id, and a DELETE
+// by clearing the tombstone its row still has in the store. An UPDATE keeps
+// the row-archive index of the other version of the row instead of the id.
+// GROUP_BEGIN and GROUP_END bracket ops that are undone and redone as one unit.
 struct UndoOp {
     OpType op;
-    Transaction data;
+    int id;
+};
+
+// ============= UNDO JOURNAL =============
+// Stack of UndoOps bounded by a memory budget. When the budget is exceeded
+// the oldest half is either spilled to a file (read back a chunk at a time
+// once the in-memory part runs dry) or, without a spill file, discarded.
+class UndoJournal {
+private:
+    vector<UndoOp> recent;            // newest at the back
+    size_t budgetBytes;
+    string spillPath;
+    FILE* spill;
+    vector<size_t> spillChunks;       // entry offset where each spilled chunk starts
+    size_t spilledEntries;
+    function<void(const UndoOp&)> onDiscard;
+
+    // 64-bit offsets, so spill files past 2 GB seek correctly everywhere
+    static bool seekTo(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+        return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+        return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+    }
+
+    void shed() {
+        size_t half = max<size_t>(1, recent.size() / 2);
+        if (spill) {
+            if (seekTo(spill, (uint64_t)spilledEntries * sizeof(UndoOp))
+                && fwrite(recent.data(), sizeof(UndoOp), half, spill) == half && fflush(spill) == 0) {
+                spillChunks.push_back(spilledEntries);
+                spilledEntries += half;
+                recent.erase(recent.begin(), recent.begin() + half);
+                return;
+            }
+            cout << "✗ Cannot write undo spill file " << spillPath << "; older undo history is discarded\n";
+            abandonSpill();
+        }
+        if (onDiscard) {
+            for (size_t i = 0; i < half; ++i) onDiscard(recent[i]);
+        }
+        recent.erase(recent.begin(), recent.begin() + half);
+    }
+
+    // Drops the spill file and everything in it. The spilled entries are
+    // older than anything left in memory, so keeping them past a gap would
+    // undo out of order; the ones that can be read back are still reported
+    // to the discard handler.
+    void abandonSpill() {
+        if (onDiscard) {
+            vector<UndoOp> chunk;
+            for (size_t c = 0; c < spillChunks.size(); ++c) {
+                size_t start = spillChunks[c];
+                size_t end = c + 1 < spillChunks.size() ? spillChunks[c + 1] : spilledEntries;
+                chunk.resize(end - start);
+                if (!seekTo(spill, (uint64_t)start * sizeof(UndoOp))
+                    || fread(chunk.data(), sizeof(UndoOp), chunk.size(), spill) != chunk.size()) {
+                    continue;
+                }
+                for (const UndoOp& op : chunk) onDiscard(op);
+            }
+        }
+        fclose(spill);
+        remove(spillPath.c_str());
+        spill = nullptr;
+        spillChunks.clear();
+        spilledEntries = 0;
+    }
+
+    // Brings the newest spilled chunk back into memory once recent runs dry.
+    // False when there is no entry left, including when the chunk could not
+    // be read back (the journal is then empty).
+    bool unspill() {
+        if (!recent.empty()) return true;
+        if (spillChunks.empty()) return false;
+        size_t start = spillChunks.back();
+        spillChunks.pop_back();
+        recent.resize(spilledEntries - start);
+        bool ok = seekTo(spill, (uint64_t)start * sizeof(UndoOp))
+               && fread(recent.data(), sizeof(UndoOp), recent.size(), spill) == recent.size();
+        spilledEntries = start;
+        if (ok) return true;
+        cout << "✗ Cannot read undo spill file " << spillPath << "; older undo history is discarded\n";
+        recent.clear();
+        abandonSpill();
+        return false;
+    }
+
+public:
+    UndoJournal() : budgetBytes(SIZE_MAX), spill(nullptr), spilledEntries(0) {}
+    UndoJournal(const UndoJournal&) = delete;
+    UndoJournal& operator=(const UndoJournal&) = delete;
+
+    ~UndoJournal() {
+        if (spill) {
+            fclose(spill);
+            remove(spillPath.c_str());
+        }
+    }
+
+    // Called for every entry dropped without a spill file
+    void setDiscardHandler(function<void(const UndoOp&)> handler) {
+        onDiscard = move(handler);
+    }
+
+    bool configure(size_t bytes, const string& path) {
+        budgetBytes = max(bytes, 2 * sizeof(UndoOp));
+        if (!path.empty() && !spill) {
+            spill = fopen(path.c_str(), "w+b");
+            if (!spill) return false;
+            spillPath = path;
+        }
+        while (memoryBytes() > budgetBytes) shed();
+        return true;
+    }
+
+    void push(const UndoOp& op) {
+        recent.push_back(op);
+        if (memoryBytes() > budgetBytes) shed();
+    }
+
+    bool empty() const { return recent.empty() && spilledEntries == 0; }
+    size_t size() const { return recent.size() + spilledEntries; }
+    size_t memoryBytes() const { return recent.size() * sizeof(UndoOp); }
+    size_t capacityBytes() const {
+        return recent.capacity() * sizeof(UndoOp) + spillChunks.capacity() * sizeof(size_t);
+    }
+    size_t spilledBytes() const { return spilledEntries * sizeof(UndoOp); }
+
+    void shrink() {
+        recent.shrink_to_fit();
+        spillChunks.shrink_to_fit();
+    }
+
+    // Both return false when the journal is empty or its spilled history is
+    // unreadable, so callers stop there without a special entry
+    bool top(UndoOp& op) {
+        if (!unspill()) return false;
+        op = recent.back();
+        return true;
+    }
+
+    bool pop(UndoOp& op) {
+        if (!unspill()) return false;
+        op = recent.back();
+        recent.pop_back();
+        return true;
+    }
+
+    void clear() {
+        recent.clear();
+        spillChunks.clear();
+        spilledEntries = 0;
+    }
+};
+
+// ============= PERSISTENT VERSION TRIE =============
+// 16-way trie from a key to a 32-bit value (0 = absent). Copies are O(1) and
+// share every node; set() copies only the nodes on its root-to-leaf path that
+// another copy still references, so each saved version costs O(log n) nodes.
+// Nodes come from the memory resource given at construction, which copies
+// share, so a manager can recycle the nodes of dropped versions without malloc.
+class VersionTrie {
+private:
+    static constexpr int BITS = 4;
+    static constexpr uint32_t WIDTH = 1u << BITS;
+
+    struct Node {
+        uint32_t refs;
+        union {
+            uint32_t value[WIDTH];    // leaf level
+            Node* child[WIDTH];       // inner levels
+        };
+    };
+
+    Node* root = nullptr;
+    int height = 0;                   // inner levels above the leaves
+    pmr::memory_resource* pool = pmr::new_delete_resource();
+
+    Node* makeNode() const {
+        Node* n = new (pool->allocate(sizeof(Node), alignof(Node))) Node();
+        n->refs = 1;
+        return n;
+    }
+
+    void release(Node* n, int level) const {
+        if (!n || --n->refs > 0) return;
+        if (level > 0) {
+            for (Node* c : n->child) release(c, level - 1);
+        }
+        pool->deallocate(n, sizeof(Node), alignof(Node));
+    }
+
+    // Makes *slot a node this trie alone owns, copying it if it is shared
+    Node* own(Node*& slot, int level) const {
+        if (!slot) return slot = makeNode();
+        if (slot->refs == 1) return slot;
+        Node* copy = new (pool->allocate(sizeof(Node), alignof(Node))) Node(*slot);
+        copy->refs = 1;
+        if (level > 0) {
+            for (Node* c : copy->child) if (c) ++c->refs;
+        }
+        --slot->refs;
+        return slot = copy;
+    }
+
+    static uint32_t digit(uint32_t key, int level) {
+        return (key >> (level * BITS)) & (WIDTH - 1);
+    }
+
+    uint64_t capacity() const {
+        return uint64_t(1) << (BITS * (height + 1));
+    }
+
+    void grow() {
+        if (root) {
+            Node* top = makeNode();
+            top->child[0] = root;
+            root = top;
+        }
+        ++height;
+    }
+
+    template <typename F>
+    static void walk(const Node* n, int level, uint32_t base, F& f) {
+        if (!n) return;
+        for (uint32_t i = 0; i < WIDTH; ++i) {
+            if (level == 0) {
+                if (n->value[i]) f(base + i, n->value[i]);
+            } else {
+                walk(n->child[i], level - 1, base + (i << (level * BITS)), f);
+            }
+        }
+    }
+
+    static void collect(const Node* n, int level, unordered_set<const void*>& seen) {
+        if (!n || !seen.insert(n).second) return;
+        if (level > 0) {
+            for (const Node* c : n->child) collect(c, level - 1, seen);
+        }
+    }
+
+    template <typename F>
+    static void diffNodes(const Node* a, const Node* b, int level, uint32_t base, F& f) {
+        if (a == b) return;
+        for (uint32_t i = 0; i < WIDTH; ++i) {
+            if (level == 0) {
+                uint32_t va = a ? a->value[i] : 0, vb = b ? b->value[i] : 0;
+                if (va != vb) f(base + i, va, vb);
+            } else {
+                diffNodes(a ? a->child[i] : nullptr, b ? b->child[i] : nullptr,
+                          level - 1, base + (i << (level * BITS)), f);
+            }
+        }
+    }
+
+public:
+    static constexpr size_t NODE_BYTES = sizeof(Node);
+
+    VersionTrie() {}
+    explicit VersionTrie(pmr::memory_resource* resource) : pool(resource) {}
+    VersionTrie(const VersionTrie& other) : root(other.root), height(other.height), pool(other.pool) {
+        if (root) ++root->refs;
+    }
+
+    VersionTrie& operator=(const VersionTrie& other) {
+        if (other.root) ++other.root->refs;
+        release(root, height);
+        root = other.root;
+        height = other.height;
+        pool = other.pool;
+        return *this;
+    }
+
+    ~VersionTrie() { release(root, height); }
+
+    uint32_t get(uint32_t key) const {
+        if (key >= capacity()) return 0;
+        const Node* n = root;
+        for (int level = height; n && level > 0; --level) n = n->child[digit(key, level)];
+        return n ? n->value[digit(key, 0)] : 0;
+    }
+
+    void set(uint32_t key, uint32_t value) {
+        while (key >= capacity()) grow();
+        Node** slot = &root;
+        for (int level = height; level > 0; --level) {
+            slot = &own(*slot, level)->child[digit(key, level)];
+        }
+        own(*slot, 0)->value[digit(key, 0)] = value;
+    }
+
+    // Calls f(key, value) for every nonzero value, in key order
+    template <typename F>
+    void forEach(F f) const {
+        walk(root, height, 0, f);
+    }
+
+    // Adds every node reachable from this trie to seen, so nodes shared
+    // between versions are counted once across calls
+    void collectNodes(unordered_set<const void*>& seen) const {
+        collect(root, height, seen);
+    }
+
+    // Calls f(key, valueInA, valueInB) for every key whose values differ.
+    // Subtrees the two versions share are skipped without being visited.
+    template <typename F>
+    static void diff(VersionTrie a, VersionTrie b, F f) {
+        while (a.height < b.height) a.grow();
+        while (b.height < a.height) b.grow();
+        diffNodes(a.root, b.root, a.height, 0, f);
+    }
+};
+
+// ============= ROARING BITMAP =============
+// A compressed set of 32-bit ids. Values are split by their high 16 bits
+// into containers. A container holds a sorted array of the low halves
+// until it passes 4096 values, the point where both forms take 8 KB, and
+// a 1024-word bitset beyond that. AND and OR work container by container,
+// so sparse sets cost little and dense ones go a word at a time.
+class RoaringBitmap {
+private:
+    static constexpr size_t ARRAY_MAX = 4096;
+    static constexpr size_t BITSET_WORDS = 1024;
+
+    struct Container {
+        uint16_t key;                  // high 16 bits
+        uint32_t cardinality = 0;
+        vector<uint16_t> array;        // sorted, when bits is empty
+        vector<uint64_t> bits;         // BITSET_WORDS words, or empty
+
+        bool isBitset() const { return !bits.empty(); }
+
+        bool contains(uint16_t low) const {
+            if (isBitset()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return binary_search(array.begin(), array.end(), low);
+        }
+
+        void toBitset() {
+            bits.assign(BITSET_WORDS, 0);
+            for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+            vector<uint16_t>().swap(array);
+        }
+
+        void toArray() {
+            array.clear();
+            array.reserve(cardinality);
+            forEach([this](uint16_t low) { array.push_back(low); });
+            vector<uint64_t>().swap(bits);
+        }
+
+        // Recounts a bitset and drops to an array when it is small enough
+        void normalize() {
+            if (!isBitset()) return;
+            cardinality = 0;
+            for (uint64_t w : bits) cardinality += __builtin_popcountll(w);
+            if (cardinality <= ARRAY_MAX) toArray();
+        }
+
+        template <typename F>
+        void forEach(F f) const {
+            if (!isBitset()) {
+                for (uint16_t low : array) f(low);
+                return;
+            }
+            for (size_t w = 0; w < BITSET_WORDS; ++w) {
+                for (uint64_t word = bits[w]; word; word &= word - 1) f(uint16_t(w * 64 + __builtin_ctzll(word)));
+            }
+        }
+    };
+
+    vector<Container> containers;      // sorted by key
+    size_t total = 0;
+
+    vector<Container>::iterator find(uint16_t key) {
+        return lower_bound(containers.begin(), containers.end(), key,
+                           [](const Container& c, uint16_t k) { return c.key < k; });
+    }
+
+    vector<Container>::const_iterator find(uint16_t key) const {
+        return lower_bound(containers.begin(), containers.end(), key,
+                           [](const Container& c, uint16_t k) { return c.key < k; });
+    }
+
+    static Container intersect(const Container& a, const Container& b) {
+        Container out;
+        out.key = a.key;
+        if (a.isBitset() && b.isBitset()) {
+            out.bits.resize(BITSET_WORDS);
+            for (size_t w = 0; w < BITSET_WORDS; ++w) out.bits[w] = a.bits[w] & b.bits[w];
+            out.normalize();
+        } else if (a.isBitset() || b.isBitset()) {
+            const Container& arr = a.isBitset() ? b : a;
+            const Container& set = a.isBitset() ? a : b;
+            for (uint16_t low : arr.array) {
+                if (set.contains(low)) out.array.push_back(low);
+            }
+            out.cardinality = out.array.size();
+        } else {
+            set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                             back_inserter(out.array));
+            out.cardinality = out.array.size();
+        }
+        return out;
+    }
+
+    static Container unite(const Container& a, const Container& b) {
+        Container out;
+        out.key = a.key;
+        if (!a.isBitset() && !b.isBitset() && a.cardinality + b.cardinality <= ARRAY_MAX) {
+            set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+            out.cardinality = out.array.size();
+            return out;
+        }
+        out.bits.assign(BITSET_WORDS, 0);
+        for (const Container* c : {&a, &b}) {
+            if (c->isBitset()) {
+                for (size_t w = 0; w < BITSET_WORDS; ++w) out.bits[w] |= c->bits[w];
+            } else {
+                for (uint16_t low : c->array) out.bits[low >> 6] |= uint64_t(1) << (low & 63);
+            }
+        }
+        out.normalize();
+        return out;
+    }
+
+public:
+    // Time Complexity: O(log containers + 4096) worst case, for an array insert
+    bool add(uint32_t value) {
+        uint16_t key = value >> 16, low = value & 0xFFFF;
+        auto it = find(key);
+        if (it == containers.end() || it->key != key) {
+            it = containers.insert(it, Container());
+            it->key = key;
+        }
+        if (it->isBitset()) {
+            uint64_t& word = it->bits[low >> 6];
+            uint64_t mask = uint64_t(1) << (low & 63);
+            if (word & mask) return false;
+            word |= mask;
+        } else {
+            auto pos = lower_bound(it->array.begin(), it->array.end(), low);
+            if (pos != it->array.end() && *pos == low) return false;
+            it->array.insert(pos, low);
+            if (it->array.size() > ARRAY_MAX) it->toBitset();
+        }
+        ++it->cardinality;
+        ++total;
+        return true;
+    }
+
+    bool remove(uint32_t value) {
+        uint16_t key = value >> 16, low = value & 0xFFFF;
+        auto it = find(key);
+        if (it == containers.end() || it->key != key || !it->contains(low)) return false;
+        if (it->isBitset()) {
+            it->bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+            if (--it->cardinality <= ARRAY_MAX / 2) it->toArray();     // hysteresis against flapping
+        } else {
+            it->array.erase(lower_bound(it->array.begin(), it->array.end(), low));
+            --it->cardinality;
+        }
+        if (it->cardinality == 0) containers.erase(it);
+        --total;
+        return true;
+    }
+
+    bool contains(uint32_t value) const {
+        auto it = find(uint16_t(value >> 16));
+        return it != containers.end() && it->key == (value >> 16) && it->contains(value & 0xFFFF);
+    }
+
+    size_t cardinality() const { return total; }
+    bool empty() const { return total == 0; }
+    size_t containerCount() const { return containers.size(); }
+
+    // Time Complexity: O(containers of both), plus the work of each matched pair
+    RoaringBitmap operator&(const RoaringBitmap& other) const {
+        RoaringBitmap out;
+        auto a = containers.begin(), b = other.containers.begin();
+        while (a != containers.end() && b != other.containers.end()) {
+            if (a->key < b->key) ++a;
+            else if (b->key < a->key) ++b;
+            else {
+                Container c = intersect(*a++, *b++);
+                if (c.cardinality == 0) continue;
+                out.total += c.cardinality;
+                out.containers.push_back(move(c));
+            }
+        }
+        return out;
+    }
+
+    RoaringBitmap operator|(const RoaringBitmap& other) const {
+        RoaringBitmap out;
+        auto a = containers.begin(), b = other.containers.begin();
+        while (a != containers.end() || b != other.containers.end()) {
+            if (b == other.containers.end() || (a != containers.end() && a->key < b->key)) out.containers.push_back(*a++);
+            else if (a == containers.end() || b->key < a->key) out.containers.push_back(*b++);
+            else out.containers.push_back(unite(*a++, *b++));
+            out.total += out.containers.back().cardinality;
+        }
+        return out;
+    }
+
+    // Calls f(value) in ascending order
+    template <typename F>
+    void forEach(F f) const {
+        for (const Container& c : containers) {
+            uint32_t high = uint32_t(c.key) << 16;
+            c.forEach([&f, high](uint16_t low) { f(high | low); });
+        }
+    }
+
+    size_t memoryBytes() const {
+        size_t bytes = containers.capacity() * sizeof(Container);
+        for (const Container& c : containers) {
+            bytes += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+};
+
+// ============= QUERY STRUCTURES =============
+// A conjunctive filter; unset fields match everything.
+struct Query {
+    bool hasDateRange = false;
+    Date start{}, end{};
+    bool hasAmountRange = false;
+    double minAmount = 0, maxAmount = 0;
+    string category;   // exact match
+    string type;       // "Income" / "Expense"
+    string keyword;    // substring of description
+
+    bool matches(const Transaction& t) const {
+        if (hasDateRange && !(t.date >= start && t.date <= end)) return false;
+        if (hasAmountRange && !(t.amount >= minAmount && t.amount <= maxAmount)) return false;
+        if (!category.empty() && t.category != category) return false;
+        if (!type.empty() && t.type != type) return false;
+        if (!keyword.empty() && t.description.find(keyword) == string::npos) return false;
+        return true;
+    }
+};
+
+// Membership filter answered from the bitmap indexes alone: a row matches
+// when it hits any value of every non-empty list. Months are Date::monthKey().
+struct BitmapQuery {
+    vector<string> categories;
+    vector<string> types;
+    vector<int> months;
 };
 
-// ============= EXPENSE MANAGER CLASS =============
-class ExpenseManager {
-private:
-    vector<Transaction> transactions;                          // Array for all transactions
-    unordered_map<string, vector<Transaction>> categoryMap;    // Hash Map for categories
-    stack<UndoOp> undoStack;                                  // Stack for undo operations
-    int nextId;
+enum AccessPath { FULL_SCAN, CATEGORY_LIST, DATE_INDEX, AMOUNT_INDEX, BITMAP_INDEX };
+
+struct QueryPlan {
+    AccessPath path = FULL_SCAN;
+    double estimatedRows = 0;   // rows the chosen path is expected to touch
+    double estimatedCost = 0;
+    size_t rowsTouched = 0;     // filled in by execution
+    size_t rowsReturned = 0;
+};
+
+// ============= PAGINATION STRUCTURES =============
+enum PageOrder { BY_ID, BY_DATE };
+
+// Offset paging skips `offset` matches; once hasCursor is set the page starts
+// right after (afterDate, afterId) in the chosen order and offset is ignored.
+struct PageRequest {
+    size_t limit = 20;
+    size_t offset = 0;
+    PageOrder order = BY_ID;
+    bool hasCursor = false;
+    int afterId = 0;
+    int afterDate = 0;     // date key, only used with BY_DATE
+};
+
+struct Page {
+    vector<Transaction> rows;
+    bool hasMore = false;
+    PageRequest next;      // keyset cursor for the following page
+};
+
+// ============= OPERATION METRICS =============
+// Call counts, latency histograms and rows scanned / returned for every
+// public operation, plus how often each access path serves a query. Each
+// thread records into its own shard, so the hot path is a handful of
+// uncontended relaxed stores and never takes a lock. Build with
+// -DEXPENSE_NO_METRICS to compile all of it out.
+
+// Log-linear latency buckets: exact below 16ns, then 16 sub-buckets per
+// power of two, so a bucket's lower bound is within 1/16 of any value in it
+struct LatencyBuckets {
+    static const int SUB_BITS = 4;
+    static const size_t COUNT = 64 << SUB_BITS;
+
+    static size_t bucketOf(uint64_t ns) {
+        if (ns < (1u << SUB_BITS)) return ns;
+        int log = 63 - __builtin_clzll(ns);
+        uint64_t sub = (ns >> (log - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+        return ((size_t)(log - SUB_BITS + 1) << SUB_BITS) + sub;
+    }
+
+    static uint64_t lowerBound(size_t bucket) {
+        if (bucket < (1u << SUB_BITS)) return bucket;
+        int log = (int)(bucket >> SUB_BITS) + SUB_BITS - 1;
+        return (uint64_t(1) << log) | (uint64_t(bucket & ((1u << SUB_BITS) - 1)) << (log - SUB_BITS));
+    }
+};
+
+enum MetricOp {
+    METRIC_ADD, METRIC_BATCH_ADD, METRIC_DELETE, METRIC_UPDATE, METRIC_UNDO, METRIC_REDO,
+    METRIC_SHOW_CATEGORY, METRIC_SHOW_ALL, METRIC_MONTHLY_TOTAL, METRIC_CATEGORY_SUMMARY,
+    METRIC_DATE_RANGE, METRIC_TOP_EXPENSES, METRIC_AMOUNT_RANGE, METRIC_KEYWORD,
+    METRIC_STATISTICS, METRIC_QUERY, METRIC_QUERY_PAGE, METRIC_SAVE, METRIC_LOAD,
+    METRIC_IMPORT, METRIC_CHECKPOINT, METRIC_QUERY_AS_OF, METRIC_RESTORE,
+    METRIC_BITMAP_QUERY, METRIC_BITMAP_COUNT,
+    METRIC_OP_COUNT
+};
+
+const char* const METRIC_OP_NAMES[METRIC_OP_COUNT] = {
+    "addTransaction", "addTransactions", "deleteTransaction", "updateTransaction", "undo", "redo",
+    "showByCategory", "showAll", "getMonthlyTotal", "showCategorySummary",
+    "searchByDateRange", "showTopExpenses", "searchByAmountRange", "searchByKeyword",
+    "showStatistics", "query", "queryPage", "save", "load",
+    "importCsv", "checkpoint", "queryAsOf", "restoreVersion",
+    "bitmapQuery", "bitmapCount",
+};
+
+const int ACCESS_PATH_COUNT = BITMAP_INDEX + 1;
+
+struct OperationMetrics {
+    uint64_t calls = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+    uint64_t rowsScanned = 0;
+    uint64_t rowsReturned = 0;
+    vector<uint64_t> latency = vector<uint64_t>(LatencyBuckets::COUNT);
+
+    // Lower bound of the bucket holding the p-th percentile, in ns
+    uint64_t percentile(double p) const {
+        uint64_t rank = (uint64_t)(p / 100.0 * calls);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < latency.size(); ++b) {
+            seen += latency[b];
+            if (seen > rank) return LatencyBuckets::lowerBound(b);
+        }
+        return 0;
+    }
+};
+
+struct AccessPathMetrics {
+    uint64_t queries = 0;
+    uint64_t rowsTouched = 0;
+    uint64_t rowsReturned = 0;
+};
+
+// Totals over every thread, taken with metricsSnapshot()
+struct MetricsSnapshot {
+    OperationMetrics ops[METRIC_OP_COUNT];
+    AccessPathMetrics paths[ACCESS_PATH_COUNT];
+};
+
+#ifndef EXPENSE_NO_METRICS
+class MetricsRegistry {
+private:
+    // Only the owning thread writes a shard, so a relaxed load + store is
+    // enough; the atomics only keep concurrent snapshot reads well-defined.
+    struct Counter {
+        atomic<uint64_t> value{0};
+        void add(uint64_t n) { value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed); }
+        void raise(uint64_t n) {
+            if (n > value.load(memory_order_relaxed)) value.store(n, memory_order_relaxed);
+        }
+        uint64_t get() const { return value.load(memory_order_relaxed); }
+    };
+
+    struct OpShard {
+        Counter calls, totalNs, maxNs, rowsScanned, rowsReturned;
+        Counter latency[LatencyBuckets::COUNT];
+    };
+
+    struct PathShard {
+        Counter queries, rowsTouched, rowsReturned;
+    };
+
+    struct Shard {
+        OpShard ops[METRIC_OP_COUNT];
+        PathShard paths[ACCESS_PATH_COUNT];
+    };
+
+    // Registers the calling thread's shard and folds it into `retired`
+    // when the thread exits
+    struct ShardOwner {
+        Shard* shard;
+        ShardOwner() : shard(new Shard()) { instance().attach(shard); }
+        ~ShardOwner() { instance().detach(shard); }
+    };
+
+    mutex lock;
+    vector<Shard*> shards;
+    MetricsSnapshot retired;
+
+    static void mergeInto(MetricsSnapshot& out, const Shard& s) {
+        for (int i = 0; i < METRIC_OP_COUNT; ++i) {
+            const OpShard& from = s.ops[i];
+            OperationMetrics& to = out.ops[i];
+            to.calls += from.calls.get();
+            to.totalNs += from.totalNs.get();
+            to.maxNs = max(to.maxNs, from.maxNs.get());
+            to.rowsScanned += from.rowsScanned.get();
+            to.rowsReturned += from.rowsReturned.get();
+            if (from.calls.get() == 0) continue;
+            for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) to.latency[b] += from.latency[b].get();
+        }
+        for (int p = 0; p < ACCESS_PATH_COUNT; ++p) {
+            out.paths[p].queries += s.paths[p].queries.get();
+            out.paths[p].rowsTouched += s.paths[p].rowsTouched.get();
+            out.paths[p].rowsReturned += s.paths[p].rowsReturned.get();
+        }
+    }
+
+    void attach(Shard* s) {
+        lock_guard<mutex> guard(lock);
+        shards.push_back(s);
+    }
+
+    void detach(Shard* s) {
+        lock_guard<mutex> guard(lock);
+        mergeInto(retired, *s);
+        shards.erase(find(shards.begin(), shards.end(), s));
+        delete s;
+    }
+
+    static Shard& local() {
+        thread_local ShardOwner owner;
+        return *owner.shard;
+    }
+
+public:
+    static MetricsRegistry& instance() {
+        static MetricsRegistry registry;
+        return registry;
+    }
+
+    static void recordCall(MetricOp op, uint64_t ns, uint64_t scanned, uint64_t returned) {
+        OpShard& s = local().ops[op];
+        s.calls.add(1);
+        s.totalNs.add(ns);
+        s.maxNs.raise(ns);
+        s.rowsScanned.add(scanned);
+        s.rowsReturned.add(returned);
+        s.latency[LatencyBuckets::bucketOf(ns)].add(1);
+    }
+
+    static void recordPath(int path, uint64_t touched, uint64_t returned) {
+        PathShard& s = local().paths[path];
+        s.queries.add(1);
+        s.rowsTouched.add(touched);
+        s.rowsReturned.add(returned);
+    }
+
+    MetricsSnapshot snapshot() {
+        lock_guard<mutex> guard(lock);
+        MetricsSnapshot out = retired;
+        for (const Shard* s : shards) mergeInto(out, *s);
+        return out;
+    }
+
+    // Counts a thread records while the reset runs may survive it
+    void reset() {
+        lock_guard<mutex> guard(lock);
+        retired = MetricsSnapshot();
+        for (Shard* s : shards) {
+            for (OpShard& op : s->ops) {
+                op.calls.value = 0;
+                op.totalNs.value = 0;
+                op.maxNs.value = 0;
+                op.rowsScanned.value = 0;
+                op.rowsReturned.value = 0;
+                for (Counter& c : op.latency) c.value = 0;
+            }
+            for (PathShard& p : s->paths) {
+                p.queries.value = 0;
+                p.rowsTouched.value = 0;
+                p.rowsReturned.value = 0;
+            }
+        }
+    }
+};
+
+// Times one operation from construction to destruction. Rows reported
+// while it is the innermost timer count towards it and every outer one,
+// so a search that runs query() is charged for the rows query() scanned.
+class MetricTimer {
+private:
+    static inline thread_local MetricTimer* current = nullptr;
+    MetricOp op;
+    MetricTimer* outer;
+    uint64_t scanned = 0;
+    uint64_t returned = 0;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit MetricTimer(MetricOp metric)
+        : op(metric), outer(current), start(chrono::steady_clock::now()) {
+        current = this;
+    }
+
+    ~MetricTimer() {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        current = outer;
+        if (outer) outer->addRows(scanned, returned);
+        MetricsRegistry::recordCall(op, (uint64_t)ns, scanned, returned);
+    }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+    void addRows(uint64_t s, uint64_t r) {
+        scanned += s;
+        returned += r;
+    }
+
+    static void rows(uint64_t s, uint64_t r) {
+        if (current) current->addRows(s, r);
+    }
+};
+
+#define EXPENSE_METRIC_SCOPE(op) MetricTimer metricTimer_(op)
+#define EXPENSE_METRIC_ROWS(scanned, returned) MetricTimer::rows(scanned, returned)
+#define EXPENSE_METRIC_PATH(path, touched, returned) MetricsRegistry::recordPath(path, touched, returned)
+#else
+#define EXPENSE_METRIC_SCOPE(op) ((void)0)
+#define EXPENSE_METRIC_ROWS(scanned, returned) ((void)0)
+#define EXPENSE_METRIC_PATH(path, touched, returned) ((void)0)
+#endif
+
+MetricsSnapshot metricsSnapshot() {
+#ifndef EXPENSE_NO_METRICS
+    return MetricsRegistry::instance().snapshot();
+#else
+    return MetricsSnapshot();
+#endif
+}
+
+void resetMetrics() {
+#ifndef EXPENSE_NO_METRICS
+    MetricsRegistry::instance().reset();
+#endif
+}
+
+// ============= BATCHED FILE I/O =============
+// The WAL, snapshot writes and CSV import queue their file operations and
+// hand a whole batch over with one submit(); wait() blocks until it is done.
+// Writes and fsyncs of one batch complete in order, so "write, then fsync"
+// is a single submission. On Linux this is io_uring, with the WAL's staging
+// buffers registered up front (WRITE_FIXED); where io_uring is missing or
+// refused, a worker thread runs the same batches with pwrite/pread/fsync.
+// A backend has at most one batch in flight and is used by one thread.
+enum IoOpKind : uint8_t { IO_WRITE, IO_READ, IO_FSYNC };
+
+struct IoOp {
+    IoOpKind kind;
+    int fd;
+    int buffer;          // registered buffer index, -1 for plain memory
+    char* data;
+    uint32_t len;
+    uint64_t offset;
+};
+
+// Runs one operation to completion with plain syscalls
+bool ioRunOp(const IoOp& op) {
+    size_t done = 0;
+    while (done < op.len || (op.kind == IO_FSYNC && done == 0)) {
+#ifdef _WIN32
+        if (op.kind == IO_FSYNC) return _commit(op.fd) == 0;
+        if (_lseeki64(op.fd, op.offset + done, SEEK_SET) < 0) return false;
+        int n = op.kind == IO_WRITE ? _write(op.fd, op.data + done, op.len - done)
+                                    : _read(op.fd, op.data + done, op.len - done);
+#else
+        if (op.kind == IO_FSYNC) return fsync(op.fd) == 0;
+        ssize_t n = op.kind == IO_WRITE ? pwrite(op.fd, op.data + done, op.len - done, op.offset + done)
+                                        : pread(op.fd, op.data + done, op.len - done, op.offset + done);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) return false;     // an error, or a read past the end of the file
+        done += n;
+    }
+    return true;
+}
+
+class IoBackend {
+protected:
+    vector<IoOp> queued;
+    vector<unique_ptr<char[]>> buffers;
+    size_t bufferBytes;
+
+public:
+    static constexpr uint32_t MAX_OP_BYTES = 1u << 30;   // larger requests are split
+
+    IoBackend(size_t bufferCount, size_t bytesPerBuffer) : bufferBytes(bytesPerBuffer) {
+        for (size_t i = 0; i < bufferCount; ++i) buffers.emplace_back(new char[bytesPerBuffer]);
+    }
+    virtual ~IoBackend() {}
+    IoBackend(const IoBackend&) = delete;
+    IoBackend& operator=(const IoBackend&) = delete;
+
+    char* buffer(size_t i) { return buffers[i].get(); }
+    size_t bufferCount() const { return buffers.size(); }
+    size_t bufferSize() const { return bufferBytes; }
+
+    // data must stay untouched until the batch is waited for
+    void write(int fd, const char* data, size_t len, uint64_t offset) {
+        for (size_t done = 0; done < len; done += MAX_OP_BYTES) {
+            uint32_t n = (uint32_t)min<size_t>(len - done, MAX_OP_BYTES);
+            queued.push_back({IO_WRITE, fd, -1, const_cast<char*>(data) + done, n, offset + done});
+        }
+    }
+
+    void writeBuffer(int fd, size_t buffer, size_t len, uint64_t offset) {
+        queued.push_back({IO_WRITE, fd, (int)buffer, buffers[buffer].get(), (uint32_t)len, offset});
+    }
+
+    void read(int fd, char* data, size_t len, uint64_t offset) {
+        for (size_t done = 0; done < len; done += MAX_OP_BYTES) {
+            uint32_t n = (uint32_t)min<size_t>(len - done, MAX_OP_BYTES);
+            queued.push_back({IO_READ, fd, -1, data + done, n, offset + done});
+        }
+    }
+
+    void fsync(int fd) {
+        queued.push_back({IO_FSYNC, fd, -1, nullptr, 0, 0});
+    }
+
+    // Starts the queued batch, first waiting for one still in flight
+    virtual void submit() = 0;
+    // True when every operation since the last wait() succeeded
+    virtual bool wait() = 0;
+    // True when no batch is in flight; never blocks
+    virtual bool idle() = 0;
+    virtual const char* name() const = 0;
+};
+
+class WorkerThreadIo : public IoBackend {
+private:
+    mutex lock;
+    condition_variable changed;
+    vector<IoOp> batch;
+    bool busy = false;
+    bool failed = false;
+    bool stopping = false;
+    thread worker;
+
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            changed.wait(guard, [this] { return stopping || busy; });
+            if (!busy) return;
+            guard.unlock();
+            bool ok = true;
+            for (const IoOp& op : batch) {
+                if (!(ok = ioRunOp(op))) break;     // like a broken io_uring link
+            }
+            guard.lock();
+            failed = failed || !ok;
+            busy = false;
+            changed.notify_all();
+        }
+    }
+
+    void drain(unique_lock<mutex>& guard) {
+        changed.wait(guard, [this] { return !busy; });
+    }
+
+public:
+    WorkerThreadIo(size_t bufferCount, size_t bytesPerBuffer)
+        : IoBackend(bufferCount, bytesPerBuffer), worker([this] { run(); }) {}
+
+    ~WorkerThreadIo() override {
+        {
+            unique_lock<mutex> guard(lock);
+            drain(guard);
+            stopping = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+
+    void submit() override {
+        if (queued.empty()) return;
+        unique_lock<mutex> guard(lock);
+        drain(guard);
+        batch.swap(queued);
+        queued.clear();
+        busy = true;
+        changed.notify_all();
+    }
+
+    bool wait() override {
+        unique_lock<mutex> guard(lock);
+        drain(guard);
+        bool ok = !failed;
+        failed = false;
+        return ok;
+    }
+
+    bool idle() override {
+        lock_guard<mutex> guard(lock);
+        return !busy;
+    }
+
+    const char* name() const override { return "worker thread"; }
+};
+
+#ifdef EXPENSE_HAS_IO_URING
+// Raw io_uring: the rings are mapped directly and driven with
+// io_uring_enter, so no liburing is needed.
+class UringIo : public IoBackend {
+private:
+    static constexpr unsigned ENTRIES = 64;
+
+    int ringFd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingBytes = 0, cqRingBytes = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqeBytes = 0;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe* cqes;
+    bool registered = false;
+
+    vector<IoOp> inflight;
+    vector<int32_t> results;
+    size_t completed = 0;
+    bool failed = false;
+
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return (int)syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0);
+    }
+
+    // Queues ops [first, last) as one linked chain and submits them
+    void start(size_t first, size_t last) {
+        bool linked = any_of(inflight.begin() + first, inflight.begin() + last,
+                             [](const IoOp& op) { return op.kind != IO_READ; });
+        unsigned tail = *sqTail;
+        for (size_t i = first; i < last; ++i) {
+            const IoOp& op = inflight[i];
+            unsigned index = tail & *sqMask;
+            io_uring_sqe& sqe = sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.fd = op.fd;
+            sqe.user_data = i;
+            if (op.kind == IO_FSYNC) {
+                sqe.opcode = IORING_OP_FSYNC;
+            } else {
+                bool fixed = op.buffer >= 0 && registered;
+                sqe.opcode = op.kind == IO_READ ? IORING_OP_READ
+                           : fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+                sqe.addr = (uint64_t)(uintptr_t)op.data;
+                sqe.len = op.len;
+                sqe.off = op.offset;
+                if (fixed) sqe.buf_index = (uint16_t)op.buffer;
+            }
+            if (linked && i + 1 < last) sqe.flags |= IOSQE_IO_LINK;
+            // A buffered write into a page that the previous fsync is still
+            // writing back blocks; punt writes so submit() never waits on that
+            if (op.kind == IO_WRITE) sqe.flags |= IOSQE_ASYNC;
+            sqArray[index] = index;
+            ++tail;
+        }
+        __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+        unsigned toSubmit = (unsigned)(last - first);
+        while (toSubmit > 0) {
+            int n = enter(toSubmit, 0, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                // Nothing more was taken. Without SQPOLL the kernel only reads
+                // entries inside io_uring_enter, so pulling the tail back to
+                // what it accepted keeps the rest from being submitted again
+                // by a later batch. Then let the accepted part of the chain
+                // finish, so the rest still runs after it, and run the rest here.
+                __atomic_store_n(sqTail, tail - toSubmit, __ATOMIC_RELEASE);
+                size_t rest = last - toSubmit;
+                reap(rest);
+                for (size_t i = rest; i < last; ++i) {
+                    results[i] = ioRunOp(inflight[i]) ? (int32_t)inflight[i].len : -EIO;
+                    ++completed;
+                }
+                break;
+            }
+            toSubmit -= n;
+        }
+    }
+
+    // Takes whatever completions are posted, without blocking
+    void poll() {
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes[head & *cqMask];
+            results[cqe.user_data] = cqe.res;
+            ++completed;
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    // Reaps completions until ops [0, upTo) have all finished
+    void reap(size_t upTo) {
+        while (true) {
+            poll();
+            if (completed >= upTo) return;
+            enter(0, 1, IORING_ENTER_GETEVENTS);
+        }
+    }
+
+    // Short transfers, and the ops a broken link cancelled, are finished
+    // synchronously in chain order
+    void settle() {
+        reap(inflight.size());
+        for (size_t i = 0; i < inflight.size() && !failed; ++i) {
+            const IoOp& op = inflight[i];
+            int32_t res = results[i];
+            if (res == -ECANCELED) {
+                failed = !ioRunOp(op);
+            } else if (res < 0) {
+                failed = true;
+            } else if (op.kind != IO_FSYNC && (uint32_t)res < op.len) {
+                IoOp rest = op;
+                rest.data += res;
+                rest.len -= res;
+                rest.offset += res;
+                failed = !ioRunOp(rest);
+            }
+        }
+        inflight.clear();
+        completed = 0;
+    }
+
+public:
+    UringIo(size_t bufferCount, size_t bytesPerBuffer) : IoBackend(bufferCount, bytesPerBuffer) {}
+
+    ~UringIo() override {
+        if (!inflight.empty()) settle();
+        if (sqes != MAP_FAILED) munmap(sqes, sqeBytes);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingBytes);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingBytes);
+        if (ringFd >= 0) ::close(ringFd);
+    }
+
+    // False when the kernel has no usable io_uring
+    bool open() {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        ringFd = (int)syscall(__NR_io_uring_setup, ENTRIES, &p);
+        if (ringFd < 0) return false;
+        sqRingBytes = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingBytes = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sqRingBytes = cqRingBytes = max(sqRingBytes, cqRingBytes);
+        sqRing = mmap(nullptr, sqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = (p.features & IORING_FEAT_SINGLE_MMAP) ? sqRing
+               : mmap(nullptr, cqRingBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                      IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqeBytes = p.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqeBytes, PROT_READ | PROT_WRITE,
+                                               MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+
+        char* sq = static_cast<char*>(sqRing);
+        char* cq = static_cast<char*>(cqRing);
+        sqTail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+        // Pinning the staging buffers saves a page walk per write; without
+        // it (e.g. RLIMIT_MEMLOCK) plain writes are used instead
+        if (!buffers.empty()) {
+            vector<iovec> iov;
+            for (auto& b : buffers) iov.push_back({b.get(), bufferBytes});
+            registered = syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_BUFFERS,
+                                 iov.data(), (unsigned)iov.size()) == 0;
+        }
+        return true;
+    }
+
+    void submit() override {
+        if (queued.empty()) return;
+        if (!inflight.empty()) settle();
+        inflight.swap(queued);
+        queued.clear();
+        results.assign(inflight.size(), 0);
+        // A batch larger than the ring goes in ring-sized rounds; only the
+        // last round is left running
+        for (size_t first = 0; first < inflight.size(); first += ENTRIES) {
+            size_t last = min(inflight.size(), first + ENTRIES);
+            if (first > 0) reap(first);
+            start(first, last);
+        }
+    }
+
+    bool wait() override {
+        if (!inflight.empty()) settle();
+        bool ok = !failed;
+        failed = false;
+        return ok;
+    }
+
+    bool idle() override {
+        if (inflight.empty()) return true;
+        poll();
+        return completed == inflight.size();
+    }
+
+    const char* name() const override { return "io_uring"; }
+};
+#endif
+
+// io_uring where the kernel allows it, the worker thread otherwise
+unique_ptr<IoBackend> makeIoBackend(size_t bufferCount = 0, size_t bytesPerBuffer = 0) {
+#ifdef EXPENSE_HAS_IO_URING
+    if (!getenv("EXPENSE_NO_IO_URING")) {
+        unique_ptr<UringIo> ring(new UringIo(bufferCount, bytesPerBuffer));
+        if (ring->open()) return ring;
+    }
+#endif
+    return unique_ptr<IoBackend>(new WorkerThreadIo(bufferCount, bytesPerBuffer));
+}
+
+// ============= SNAPSHOT FORMAT =============
+// Columnar binary snapshot:
+//   header | string dictionary | id | date | amount | category | type | description
+// Every section starts on an 8-byte boundary and carries its own CRC-32.
+// String columns hold dictionary codes; the dictionary is an offset table
+// (count + 1 entries) followed by the concatenated bytes.
+enum SnapshotSection { SEC_DICT, SEC_ID, SEC_DATE, SEC_AMOUNT, SEC_CATEGORY, SEC_TYPE, SEC_DESC, SEC_COUNT };
+
+struct SnapshotHeader {
+    char magic[8];                  // "EXPSNAP\0"
+    uint32_t version;
+    uint32_t dictCount;
+    uint64_t rowCount;
+    int32_t nextId;
+    uint32_t walGeneration;         // WAL files older than this are already folded in
+    uint64_t offset[SEC_COUNT];
+    uint64_t bytes[SEC_COUNT];
+    uint32_t checksum[SEC_COUNT];
+    uint32_t headerChecksum;        // covers every field above
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'E', 'X', 'P', 'S', 'N', 'A', 'P', '\0'};
+static const uint32_t SNAPSHOT_VERSION = 1;
+
+struct Crc32Table {
+    uint32_t entry[256];
+    Crc32Table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            entry[i] = c;
+        }
+    }
+};
+
+// Safe to call from several threads; the table is built once on first use
+uint32_t crc32(const void* data, size_t len, uint32_t crc = 0) {
+    static const Crc32Table table;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) crc = table.entry[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// A snapshot's columns, copied out of the ledger. write() only reads the
+// image, so it can run on another thread while the ledger keeps changing.
+struct SnapshotImage {
+    SnapshotHeader header;
+    vector<char> dictBytes;
+    vector<int32_t> ids, dates;
+    vector<double> amounts;
+    vector<uint32_t> cats, types, descs;
+
+    // Lays out the sections, checksums them and writes path atomically
+    bool write(const string& path, IoBackend& io) {
+        SnapshotHeader& h = header;
+        size_t n = h.rowCount;
+        const void* sections[SEC_COUNT] = {dictBytes.data(), ids.data(), dates.data(), amounts.data(),
+                                           cats.data(), types.data(), descs.data()};
+        h.bytes[SEC_DICT] = dictBytes.size();
+        h.bytes[SEC_ID] = n * sizeof(int32_t);
+        h.bytes[SEC_DATE] = n * sizeof(int32_t);
+        h.bytes[SEC_AMOUNT] = n * sizeof(double);
+        h.bytes[SEC_CATEGORY] = h.bytes[SEC_TYPE] = h.bytes[SEC_DESC] = n * sizeof(uint32_t);
+        uint64_t offset = sizeof(SnapshotHeader);
+        for (int sec = 0; sec < SEC_COUNT; ++sec) {
+            offset = (offset + 7) & ~uint64_t(7);
+            h.offset[sec] = offset;
+            h.checksum[sec] = crc32(sections[sec], h.bytes[sec]);
+            offset += h.bytes[sec];
+        }
+        h.headerChecksum = crc32(&h, offsetof(SnapshotHeader, headerChecksum));
+
+        // Write to a temporary file and rename so a crash never leaves a torn
+        // snapshot. Every section goes out in one batch with the fsync.
+        string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        if (fd < 0) return false;
+        static const char zeros[8] = {};
+        io.write(fd, reinterpret_cast<const char*>(&h), sizeof(h), 0);
+        uint64_t written = sizeof(h);
+        for (int sec = 0; sec < SEC_COUNT; ++sec) {
+            io.write(fd, zeros, h.offset[sec] - written, written);
+            io.write(fd, static_cast<const char*>(sections[sec]), h.bytes[sec], h.offset[sec]);
+            written = h.offset[sec] + h.bytes[sec];
+        }
+        io.fsync(fd);
+        io.submit();
+        bool ok = io.wait();
+        ok = ::close(fd) == 0 && ok;
+        return ok && rename(tmp.c_str(), path.c_str()) == 0;
+    }
+};
+
+// Read-only view of a whole file: mmap where available, a heap copy otherwise
+class MappedFile {
+private:
+    const char* base;
+    size_t length;
+    vector<char> fallback;
+
+public:
+    MappedFile() : base(nullptr), length(0) {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (base && fallback.empty()) munmap(const_cast<char*>(base), length);
+#endif
+    }
+
+    bool open(const string& path) {
+#ifndef _WIN32
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        base = static_cast<const char*>(p);
+        length = st.st_size;
+        return true;
+#else
+        ifstream in(path, ios::binary | ios::ate);
+        if (!in) return false;
+        fallback.resize((size_t)in.tellg());
+        in.seekg(0);
+        if (fallback.empty() || !in.read(fallback.data(), fallback.size())) return false;
+        base = fallback.data();
+        length = fallback.size();
+        return true;
+#endif
+    }
+
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+};
+
+// ============= COLUMNAR SEGMENTS =============
+// Immutable segment files of up to SEGMENT_ROWS rows each, for ledgers too
+// big to keep in memory. A segment is laid out like a snapshot - 8-byte
+// aligned, checksummed column sections - so it is used straight from an
+// mmap. Two dictionaries keep the small one cheap to read: labels
+// (categories and types) and descriptions. Every column is stored in a
+// compact encoding (see ColumnEncoding), typically 4-6 bytes a row in all.
+// The header carries a zone map and the category list, so a scan skips
+// segments whose min/max or categories can't match.
+// LSM runs use the same files with rows in (date, id) order, plus deleted
+// ids (tombstones), an id-ordered row permutation and a bloom filter.
+static const uint32_t SEGMENT_ROWS = 1 << 16;
+
+enum SegmentSection { SEG_LABELS, SEG_DESC_DICT, SEG_ID, SEG_DATE, SEG_AMOUNT, SEG_CATEGORY, SEG_TYPE,
+                      SEG_DESC, SEG_CATEGORY_CODES, SEG_TOMBSTONES, SEG_ID_ORDER, SEG_BLOOM, SEG_COUNT };
+
+enum SegmentFlags : uint32_t {
+    SEGMENT_BY_DATE = 1,       // rows sorted by (date, id); otherwise by id
+};
+
+// Bloom filter over ids, probed with double hashing of one 64-bit mix
+struct BloomFilter {
+    static uint64_t mix(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+    static uint32_t hashesFor(size_t bitsPerKey) {
+        return (uint32_t)max<size_t>(1, min<size_t>(30, bitsPerKey * 69 / 100));    // ~ln 2 per bit
+    }
+
+    static vector<uint64_t> build(const vector<int32_t>& keys, size_t bitsPerKey, uint32_t hashes) {
+        size_t bits = max<size_t>(64, keys.size() * bitsPerKey);
+        vector<uint64_t> words((bits + 63) / 64);
+        bits = words.size() * 64;
+        for (int32_t key : keys) {
+            uint64_t h = mix((uint32_t)key);
+            uint64_t step = (h >> 32) | 1;
+            for (uint32_t i = 0; i < hashes; ++i, h += step) words[(h % bits) / 64] |= uint64_t(1) << (h % 64);
+        }
+        return words;
+    }
+
+    static bool mayContain(const uint64_t* words, size_t wordCount, uint32_t hashes, int32_t key) {
+        if (wordCount == 0) return true;
+        size_t bits = wordCount * 64;
+        uint64_t h = mix((uint32_t)key);
+        uint64_t step = (h >> 32) | 1;
+        for (uint32_t i = 0; i < hashes; ++i, h += step) {
+            if (!(words[(h % bits) / 64] & (uint64_t(1) << (h % 64)))) return false;
+        }
+        return true;
+    }
+};
+
+// Optional parts of a segment, used by LSM runs
+struct SegmentExtras {
+    bool sortedByDate = false;
+    vector<int32_t> tombstones;    // sorted ids deleted by this run
+    size_t bloomBitsPerKey = 0;    // 0 = no bloom filter
+    int nextId = 0;
+};
+
+// Column encodings. A column holds int64 values - ids, date keys,
+// dictionary codes, amounts in cents - stored as whichever of these is
+// smaller:
+//   COL_PACKED  frame of reference: blocks of 128 values, value j of a
+//               block stored as a width-bit offset from base + j * step.
+//               step is the block's average delta when that narrows the
+//               offsets, so consecutive ids take no bits and nearly sorted
+//               dates only a few
+//   COL_RLE     (value, run end) pairs, for columns with long runs
+//   COL_DOUBLE  raw doubles, for amounts that are not whole cents
+// Packed values are read in place; aggregates over a range sum the block
+// minimums and offsets, or whole runs, without building the values.
+enum ColumnEncoding : uint32_t { COL_PACKED = 1, COL_RLE, COL_DOUBLE };
+
+struct ColumnHeader {
+    uint32_t encoding;
+    uint32_t count;        // values
+    uint32_t parts;        // blocks (COL_PACKED) or runs (COL_RLE)
+    uint32_t scale;        // stored value = value * scale (100 for amounts in cents)
+};
+
+struct PackedBlock {
+    int64_t base;
+    int64_t step;          // value j = base + j * step + offset j
+    uint32_t word;         // first data word
+    uint32_t width;        // bits per offset, 0-64
+};
+
+static const size_t PACKED_BLOCK = 128;     // 128 * width bits = 2 * width words
+
+vector<char> encodeColumn(const vector<int64_t>& values, uint32_t scale = 1) {
+    size_t count = values.size(), blocks = (count + PACKED_BLOCK - 1) / PACKED_BLOCK;
+    vector<PackedBlock> packed(blocks);
+    size_t words = 0, runs = 0;
+    // Offsets of a block against base + j * step: (base, bits needed)
+    auto frame = [&values](size_t first, size_t last, int64_t step) {
+        uint64_t lo = UINT64_MAX, hi = 0;
+        for (size_t i = first; i < last; ++i) {
+            uint64_t v = (uint64_t)values[i] - (uint64_t)step * (i - first) + (uint64_t(1) << 63);
+            lo = min(lo, v);
+            hi = max(hi, v);
+        }
+        uint64_t range = hi - lo;
+        return make_pair((int64_t)(lo - (uint64_t(1) << 63)),
+                         range == 0 ? 0u : 64u - (uint32_t)__builtin_clzll(range));
+    };
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t first = b * PACKED_BLOCK, last = min(count, first + PACKED_BLOCK);
+        auto flat = frame(first, last, 0);
+        packed[b] = {flat.first, 0, (uint32_t)words, flat.second};
+        if (last - first > 1) {
+            int64_t step = (int64_t)((uint64_t)values[last - 1] - (uint64_t)values[first]) / (int64_t)(last - first - 1);
+            auto sloped = frame(first, last, step);
+            if (step != 0 && sloped.second < flat.second) packed[b] = {sloped.first, step, (uint32_t)words, sloped.second};
+        }
+        words += 2 * packed[b].width;
+    }
+    for (size_t i = 0; i < count; ++i) runs += i == 0 || values[i] != values[i - 1];
+
+    ColumnHeader h{COL_PACKED, (uint32_t)count, (uint32_t)blocks, scale};
+    ++words;     // a zero word past the end lets readers load 8 bytes at any offset
+    size_t packedBytes = blocks * sizeof(PackedBlock) + words * sizeof(uint64_t);
+    size_t rleBytes = runs * sizeof(int64_t) + ((runs * sizeof(uint32_t) + 7) & ~size_t(7));
+    vector<char> out;
+    auto put = [&out](const void* p, size_t bytes) {
+        const char* c = static_cast<const char*>(p);
+        out.insert(out.end(), c, c + bytes);
+    };
+    if (rleBytes < packedBytes) {
+        h.encoding = COL_RLE;
+        h.parts = runs;
+        vector<int64_t> runValues;
+        vector<uint32_t> runEnds;
+        for (size_t i = 0; i < count; ++i) {
+            if (i == 0 || values[i] != values[i - 1]) runValues.push_back(values[i]);
+            else runEnds.pop_back();
+            runEnds.push_back(i + 1);
+        }
+        put(&h, sizeof(h));
+        put(runValues.data(), runs * sizeof(int64_t));
+        put(runEnds.data(), runs * sizeof(uint32_t));
+        out.resize(sizeof(h) + rleBytes);      // pad to 8 bytes
+        return out;
+    }
+    vector<uint64_t> data(words);
+    for (size_t i = 0; i < count; ++i) {
+        const PackedBlock& blk = packed[i / PACKED_BLOCK];
+        if (blk.width == 0) continue;
+        uint64_t v = (uint64_t)values[i] - (uint64_t)blk.step * (i % PACKED_BLOCK) - (uint64_t)blk.base;
+        size_t bit = (i % PACKED_BLOCK) * blk.width, w = blk.word + bit / 64, shift = bit % 64;
+        data[w] |= v << shift;
+        if (shift + blk.width > 64) data[w + 1] |= v >> (64 - shift);
+    }
+    put(&h, sizeof(h));
+    put(packed.data(), blocks * sizeof(PackedBlock));
+    put(data.data(), words * sizeof(uint64_t));
+    return out;
+}
+
+// Amounts that are all whole cents (nearly always) are stored as integers
+vector<char> encodeAmounts(const vector<double>& amounts) {
+    vector<int64_t> cents(amounts.size());
+    for (size_t i = 0; i < amounts.size(); ++i) {
+        double c = nearbyint(amounts[i] * 100);
+        if (!(fabs(c) < 9007199254740992.0 && c / 100 == amounts[i])) {
+            ColumnHeader h{COL_DOUBLE, (uint32_t)amounts.size(), 0, 1};
+            vector<char> out(sizeof(h) + amounts.size() * sizeof(double));
+            memcpy(out.data(), &h, sizeof(h));
+            memcpy(out.data() + sizeof(h), amounts.data(), amounts.size() * sizeof(double));
+            return out;
+        }
+        cents[i] = (int64_t)c;
+    }
+    return encodeColumn(cents, 100);
+}
+
+// A view of one encoded column inside a mapped segment
+class ColumnReader {
+private:
+    ColumnHeader h{};
+    const PackedBlock* blocks = nullptr;
+    const uint64_t* words = nullptr;
+    const int64_t* runValues = nullptr;
+    const uint32_t* runEnds = nullptr;
+    const double* doubles = nullptr;
+
+    // Index of the run holding row i
+    size_t runOf(size_t i) const { return upper_bound(runEnds, runEnds + h.parts, (uint32_t)i) - runEnds; }
+
+    static uint64_t unpack(const uint64_t* data, size_t bit, uint32_t width) {
+        if (width == 0) return 0;
+        size_t w = bit / 64, shift = bit % 64;
+        uint64_t v = data[w] >> shift;
+        if (shift + width > 64) v |= data[w + 1] << (64 - shift);
+        return width == 64 ? v : v & ((uint64_t(1) << width) - 1);
+    }
+
+public:
+    // Checks every bound the readers rely on
+    bool open(const char* p, uint64_t bytes, size_t expectedCount) {
+        if (bytes < sizeof(h)) return false;
+        memcpy(&h, p, sizeof(h));
+        if (h.count != expectedCount || h.scale == 0) return false;
+        p += sizeof(h);
+        bytes -= sizeof(h);
+        switch (h.encoding) {
+        case COL_PACKED: {
+            if (h.parts != (h.count + PACKED_BLOCK - 1) / PACKED_BLOCK || bytes < h.parts * sizeof(PackedBlock)) {
+                return false;
+            }
+            blocks = reinterpret_cast<const PackedBlock*>(p);
+            words = reinterpret_cast<const uint64_t*>(p + h.parts * sizeof(PackedBlock));
+            uint64_t wordCount = (bytes - h.parts * sizeof(PackedBlock)) / sizeof(uint64_t);
+            for (uint32_t b = 0; b < h.parts; ++b) {
+                if (blocks[b].width > 64 || blocks[b].word + 2 * (uint64_t)blocks[b].width + 1 > wordCount) return false;
+            }
+            return true;
+        }
+        case COL_RLE:
+            if (bytes < h.parts * (sizeof(int64_t) + sizeof(uint32_t))) return false;
+            runValues = reinterpret_cast<const int64_t*>(p);
+            runEnds = reinterpret_cast<const uint32_t*>(p + h.parts * sizeof(int64_t));
+            for (uint32_t r = 0; r < h.parts; ++r) {
+                if (runEnds[r] <= (r ? runEnds[r - 1] : 0)) return false;
+            }
+            return h.parts ? runEnds[h.parts - 1] == h.count : h.count == 0;
+        case COL_DOUBLE:
+            doubles = reinterpret_cast<const double*>(p);
+            return bytes >= h.count * sizeof(double);
+        }
+        return false;
+    }
+
+    ColumnEncoding encoding() const { return (ColumnEncoding)h.encoding; }
+    size_t size() const { return h.count; }
+
+    // True when every value is an integer in [lo, hi); one decode pass,
+    // or one look at each run
+    bool inRange(int64_t lo, int64_t hi) const {
+        if (h.encoding == COL_DOUBLE) return false;
+        if (h.encoding == COL_RLE) {
+            for (uint32_t r = 0; r < h.parts; ++r) {
+                if (runValues[r] < lo || runValues[r] >= hi) return false;
+            }
+            return true;
+        }
+        int64_t buffer[PACKED_BLOCK];
+        for (size_t first = 0; first < h.count; first += PACKED_BLOCK) {
+            size_t n = min<size_t>(PACKED_BLOCK, h.count - first);
+            decode(first, n, buffer);
+            for (size_t i = 0; i < n; ++i) {
+                if (buffer[i] < lo || buffer[i] >= hi) return false;
+            }
+        }
+        return true;
+    }
+
+    int64_t get(size_t i) const {
+        if (h.encoding == COL_RLE) return runValues[runOf(i)];
+        const PackedBlock& blk = blocks[i / PACKED_BLOCK];
+        size_t j = i % PACKED_BLOCK;
+        return (int64_t)((uint64_t)blk.base + (uint64_t)blk.step * j + unpack(words + blk.word, j * blk.width, blk.width));
+    }
+
+    double getDouble(size_t i) const {
+        return h.encoding == COL_DOUBLE ? doubles[i] : (double)get(i) / h.scale;
+    }
+
+    // Values [first, first + n) into out
+    void decode(size_t first, size_t n, int64_t* out) const {
+        size_t last = first + n;
+        if (h.encoding == COL_RLE) {
+            for (size_t r = runOf(first), i = first; i < last; ++r) {
+                for (size_t end = min<size_t>(runEnds[r], last); i < end; ++i) *out++ = runValues[r];
+            }
+            return;
+        }
+        for (size_t i = first; i < last;) {
+            const PackedBlock& blk = blocks[i / PACKED_BLOCK];
+            size_t end = min(last, (i / PACKED_BLOCK + 1) * PACKED_BLOCK);
+            uint64_t base = blk.base, step = blk.step;
+            size_t j = i % PACKED_BLOCK, jEnd = j + (end - i);
+            i = end;
+            if (blk.width == 0) {
+                for (; j < jEnd; ++j) *out++ = (int64_t)(base + step * j);
+                continue;
+            }
+            const uint64_t* data = words + blk.word;
+            uint32_t width = blk.width;
+            uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+            if (width <= 56) {
+                // One unaligned load per value, no word-straddling branch
+                const char* bytes = reinterpret_cast<const char*>(data);
+                for (; j < jEnd; ++j) {
+                    size_t bit = j * width;
+                    uint64_t v;
+                    memcpy(&v, bytes + bit / 8, sizeof(v));
+                    *out++ = (int64_t)(base + step * j + ((v >> (bit % 8)) & mask));
+                }
+                continue;
+            }
+            for (; j < jEnd; ++j) *out++ = (int64_t)(base + step * j + unpack(data, j * width, width));
+        }
+    }
+
+    // Values [first, first + n) into out, unscaled
+    void decodeDoubles(size_t first, size_t n, double* out) const {
+        if (h.encoding == COL_DOUBLE) {
+            copy_n(doubles + first, n, out);
+            return;
+        }
+        int64_t buffer[PACKED_BLOCK];
+        for (size_t done = 0; done < n;) {
+            size_t m = min(PACKED_BLOCK, n - done);
+            decode(first + done, m, buffer);
+            for (size_t i = 0; i < m; ++i) out[done + i] = (double)buffer[i] / h.scale;
+            done += m;
+        }
+    }
+
+    // Sum of the stored integers in [first, last): whole runs at a time, or
+    // each block's frame (base and step) in closed form plus the packed offsets
+    int64_t sum(size_t first, size_t last) const {
+        uint64_t total = 0;
+        if (h.encoding == COL_RLE) {
+            for (size_t r = runOf(first), i = first; i < last; ++r) {
+                size_t end = min<size_t>(runEnds[r], last);
+                total += (uint64_t)runValues[r] * (end - i);
+                i = end;
+            }
+            return (int64_t)total;
+        }
+        for (size_t i = first; i < last;) {
+            const PackedBlock& blk = blocks[i / PACKED_BLOCK];
+            size_t end = min(last, (i / PACKED_BLOCK + 1) * PACKED_BLOCK);
+            uint64_t j0 = i % PACKED_BLOCK, j1 = j0 + (end - i);          // sum of j over [j0, j1)
+            total += (uint64_t)blk.base * (end - i) + (uint64_t)blk.step * ((j1 * (j1 - 1) - j0 * (j0 - 1)) / 2);
+            if (blk.width > 0) {
+                for (size_t bit = (i % PACKED_BLOCK) * blk.width; i < end; ++i, bit += blk.width) {
+                    total += unpack(words + blk.word, bit, blk.width);
+                }
+            }
+            i = end;
+        }
+        return (int64_t)total;
+    }
+
+    // Sum of the values in [first, last), unscaled
+    double sumDouble(size_t first, size_t last) const {
+        if (h.encoding != COL_DOUBLE) return (double)sum(first, last) / h.scale;
+        double total = 0;
+        for (size_t i = first; i < last; ++i) total += doubles[i];
+        return total;
+    }
+
+    // Calls f(first, last, value) for every run overlapping [first, last)
+    template <typename F>
+    void forEachRun(size_t first, size_t last, F f) const {
+        for (size_t r = runOf(first), i = first; i < last; ++r) {
+            size_t end = min<size_t>(runEnds[r], last);
+            f(i, end, runValues[r]);
+            i = end;
+        }
+    }
+};
+
+// Min/max of each ordered column; NaN amounts never occur (every mutation rejects them)
+struct ZoneMap {
+    int32_t minId, maxId;
+    int32_t minDate, maxDate;      // date keys
+    double minAmount, maxAmount;
+
+    bool mayMatch(const Query& q) const {
+        if (q.hasDateRange && (maxDate < q.start.key() || minDate > q.end.key())) return false;
+        if (q.hasAmountRange && (maxAmount < q.minAmount || minAmount > q.maxAmount)) return false;
+        return true;
+    }
+};
+
+struct SegmentHeader {
+    char magic[8];                  // "EXPSEG\0\0"
+    uint32_t version;
+    uint32_t rowCount;
+    uint32_t labelCount;
+    uint32_t descCount;
+    uint32_t categoryCount;         // distinct categories
+    uint32_t flags;                 // SegmentFlags
+    uint32_t tombstoneCount;
+    uint32_t bloomHashes;
+    int32_t nextId;                 // LSM runs: first id not yet assigned when written
+    uint32_t reserved;
+    ZoneMap zone;
+    uint64_t offset[SEG_COUNT];
+    uint64_t bytes[SEG_COUNT];
+    uint32_t checksum[SEG_COUNT];
+    uint32_t headerChecksum;        // covers every field above
+};
+
+static const char SEGMENT_MAGIC[8] = {'E', 'X', 'P', 'S', 'E', 'G', '\0', '\0'};
+static const uint32_t SEGMENT_VERSION = 3;
+
+// Dictionary layout shared by snapshots and segments: (count + 1) u32
+// offsets followed by the concatenated bytes
+vector<char> packDictionary(const vector<string_view>& dict) {
+    size_t table = (dict.size() + 1) * sizeof(uint32_t);
+    size_t total = table;
+    for (string_view s : dict) total += s.size();
+    vector<char> bytes(total);
+    uint32_t offset = 0;
+    for (size_t i = 0; i <= dict.size(); ++i) {
+        memcpy(bytes.data() + i * sizeof(uint32_t), &offset, sizeof(offset));
+        if (i == dict.size()) break;
+        // Arena views of empty strings have no data pointer at all
+        if (!dict[i].empty()) memcpy(bytes.data() + table + offset, dict[i].data(), dict[i].size());
+        offset += dict[i].size();
+    }
+    return bytes;
+}
+
+// False when the offsets run backwards or past the section's bytes
+bool unpackDictionary(const char* base, uint64_t bytes, uint32_t count, vector<string_view>& dict) {
+    uint64_t table = ((uint64_t)count + 1) * sizeof(uint32_t);
+    if (bytes < table) return false;
+    const uint32_t* offsets = reinterpret_cast<const uint32_t*>(base);
+    const char* strings = base + table;
+    if (offsets[0] != 0 || offsets[count] > bytes - table) return false;
+    dict.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        if (offsets[i + 1] < offsets[i]) return false;
+        dict[i] = string_view(strings + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+    return true;
+}
+
+// Writes rows (in the order given: by id, or by (date, id) with
+// extras.sortedByDate) as one segment file through io, fsynced
+bool writeSegment(const string& path, const Transaction* rows, size_t count, IoBackend& io,
+                  const SegmentExtras& extras = SegmentExtras()) {
+    SegmentHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SEGMENT_MAGIC, sizeof(h.magic));
+    h.version = SEGMENT_VERSION;
+    h.rowCount = count;
+    h.flags = extras.sortedByDate ? (uint32_t)SEGMENT_BY_DATE : 0;
+    h.tombstoneCount = extras.tombstones.size();
+    h.nextId = extras.nextId;
+
+    unordered_map<string_view, uint32_t> labelCodes, descCodes;
+    vector<string_view> labels, descDict;
+    auto encode = [](unordered_map<string_view, uint32_t>& codes, vector<string_view>& dict, string_view s) {
+        auto it = codes.emplace(s, (uint32_t)dict.size());
+        if (it.second) dict.push_back(s);
+        return it.first->second;
+    };
+    vector<int64_t> ids(count), dates(count), cats(count), types(count), descs(count);
+    vector<double> amounts(count);
+    set<uint32_t> categoryLabels;
+    // Types take the first label codes, so the type column packs to a bit or two
+    for (size_t i = 0; i < count; ++i) encode(labelCodes, labels, rows[i].type);
+    ZoneMap& z = h.zone;
+    z = {INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN, HUGE_VAL, -HUGE_VAL};
+    for (size_t i = 0; i < count; ++i) {
+        const Transaction& t = rows[i];
+        ids[i] = t.id;
+        dates[i] = t.date.key();
+        amounts[i] = t.amount;
+        cats[i] = encode(labelCodes, labels, t.category);
+        types[i] = encode(labelCodes, labels, t.type);
+        descs[i] = encode(descCodes, descDict, t.description);
+        categoryLabels.insert(cats[i]);
+        z.minId = min(z.minId, t.id);
+        z.maxId = max(z.maxId, t.id);
+        z.minDate = min(z.minDate, (int32_t)dates[i]);
+        z.maxDate = max(z.maxDate, (int32_t)dates[i]);
+        z.minAmount = min(z.minAmount, t.amount);
+        z.maxAmount = max(z.maxAmount, t.amount);
+    }
+    h.labelCount = labels.size();
+    h.descCount = descDict.size();
+    h.categoryCount = categoryLabels.size();
+    vector<char> labelBytes = packDictionary(labels), descBytes = packDictionary(descDict);
+    vector<uint32_t> categoryCodes(categoryLabels.begin(), categoryLabels.end());
+    // Id lookups need an id-ordered view unless the rows already are
+    vector<int64_t> idOrder;
+    if (extras.sortedByDate) {
+        idOrder.resize(count);
+        for (size_t i = 0; i < count; ++i) idOrder[i] = i;
+        sort(idOrder.begin(), idOrder.end(), [&ids](int64_t a, int64_t b) { return ids[a] < ids[b]; });
+    }
+    vector<uint64_t> bloom;
+    if (extras.bloomBitsPerKey > 0) {
+        vector<int32_t> keys(ids.begin(), ids.end());
+        keys.insert(keys.end(), extras.tombstones.begin(), extras.tombstones.end());
+        h.bloomHashes = BloomFilter::hashesFor(extras.bloomBitsPerKey);
+        bloom = BloomFilter::build(keys, extras.bloomBitsPerKey, h.bloomHashes);
+    }
+
+    vector<char> columns[] = {encodeColumn(ids), encodeColumn(dates), encodeAmounts(amounts), encodeColumn(cats),
+                              encodeColumn(types), encodeColumn(descs),
+                              idOrder.empty() ? vector<char>() : encodeColumn(idOrder)};
+    const void* sections[SEG_COUNT] = {labelBytes.data(), descBytes.data(), columns[0].data(), columns[1].data(),
+                                       columns[2].data(), columns[3].data(), columns[4].data(), columns[5].data(),
+                                       categoryCodes.data(), extras.tombstones.data(), columns[6].data(),
+                                       bloom.data()};
+    h.bytes[SEG_LABELS] = labelBytes.size();
+    h.bytes[SEG_DESC_DICT] = descBytes.size();
+    for (int sec = SEG_ID; sec <= SEG_DESC; ++sec) h.bytes[sec] = columns[sec - SEG_ID].size();
+    h.bytes[SEG_CATEGORY_CODES] = categoryCodes.size() * sizeof(uint32_t);
+    h.bytes[SEG_TOMBSTONES] = extras.tombstones.size() * sizeof(int32_t);
+    h.bytes[SEG_ID_ORDER] = columns[6].size();
+    h.bytes[SEG_BLOOM] = bloom.size() * sizeof(uint64_t);
+    uint64_t offset = sizeof(SegmentHeader);
+    for (int sec = 0; sec < SEG_COUNT; ++sec) {
+        offset = (offset + 7) & ~uint64_t(7);
+        h.offset[sec] = offset;
+        h.checksum[sec] = crc32(sections[sec], h.bytes[sec]);
+        offset += h.bytes[sec];
+    }
+    h.headerChecksum = crc32(&h, offsetof(SegmentHeader, headerChecksum));
+
+    string tmp = path + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+    if (fd < 0) return false;
+    static const char zeros[8] = {};
+    io.write(fd, reinterpret_cast<const char*>(&h), sizeof(h), 0);
+    uint64_t written = sizeof(h);
+    for (int sec = 0; sec < SEG_COUNT; ++sec) {
+        io.write(fd, zeros, h.offset[sec] - written, written);
+        io.write(fd, static_cast<const char*>(sections[sec]), h.bytes[sec], h.offset[sec]);
+        written = h.offset[sec] + h.bytes[sec];
+    }
+    io.fsync(fd);
+    io.submit();
+    bool ok = io.wait();
+    ok = ::close(fd) == 0 && ok;
+    return ok && rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// A mapped segment. Row strings are views into the mapping, so rows handed
+// out stay valid only while the Segment is alive.
+class Segment {
+private:
+    MappedFile file;
+    SegmentHeader h;
+    vector<string_view> labels, descDict;
+    const uint32_t* categoryCodes = nullptr;
+    ColumnReader idCol, dateCol, amountCol, catCol, typeCol, descCol, idOrderCol;
+
+    const char* section(int sec) const { return file.data() + h.offset[sec]; }
+
+    bool openColumn(ColumnReader& col, int sec, size_t count) const {
+        return col.open(section(sec), h.bytes[sec], count);
+    }
+
+    static constexpr size_t SCAN_CHUNK = 1024;
+
+public:
+    // Header, bounds, dictionaries and code ranges are always checked, so a
+    // damaged file is rejected rather than read out of bounds; the section
+    // checksums only when verify is set
+    bool open(const string& path, bool verify) {
+        if (!file.open(path) || file.size() < sizeof(SegmentHeader)) return false;
+        memcpy(&h, file.data(), sizeof(h));
+        bool valid = memcmp(h.magic, SEGMENT_MAGIC, sizeof(h.magic)) == 0 && h.version == SEGMENT_VERSION
+                  && h.headerChecksum == crc32(&h, offsetof(SegmentHeader, headerChecksum));
+        for (int sec = 0; valid && sec < SEG_COUNT; ++sec) {
+            valid = h.offset[sec] % 8 == 0 && h.bytes[sec] <= file.size() && h.offset[sec] <= file.size() - h.bytes[sec]
+                 && (!verify || h.checksum[sec] == crc32(section(sec), h.bytes[sec]));
+        }
+        valid = valid && h.bytes[SEG_TOMBSTONES] == h.tombstoneCount * sizeof(int32_t)
+                      && h.bytes[SEG_CATEGORY_CODES] == h.categoryCount * sizeof(uint32_t)
+                      && openColumn(idCol, SEG_ID, h.rowCount) && openColumn(dateCol, SEG_DATE, h.rowCount)
+                      && openColumn(amountCol, SEG_AMOUNT, h.rowCount) && openColumn(catCol, SEG_CATEGORY, h.rowCount)
+                      && openColumn(typeCol, SEG_TYPE, h.rowCount) && openColumn(descCol, SEG_DESC, h.rowCount)
+                      && (h.bytes[SEG_ID_ORDER] == 0 || openColumn(idOrderCol, SEG_ID_ORDER, h.rowCount))
+                      && unpackDictionary(section(SEG_LABELS), h.bytes[SEG_LABELS], h.labelCount, labels)
+                      && unpackDictionary(section(SEG_DESC_DICT), h.bytes[SEG_DESC_DICT], h.descCount, descDict);
+        if (!valid) return false;
+        categoryCodes = reinterpret_cast<const uint32_t*>(section(SEG_CATEGORY_CODES));
+        for (uint32_t c = 0; c < h.categoryCount; ++c) {
+            if (categoryCodes[c] >= h.labelCount) return false;
+        }
+        // Ids and dates are read with get(), so they must be integer columns too
+        return idCol.encoding() != COL_DOUBLE && dateCol.encoding() != COL_DOUBLE
+            && catCol.inRange(0, h.labelCount) && typeCol.inRange(0, h.labelCount)
+            && descCol.inRange(0, h.descCount)
+            && (h.bytes[SEG_ID_ORDER] == 0 || idOrderCol.inRange(0, h.rowCount));
+    }
+
+    const int32_t* tombstones() const { return reinterpret_cast<const int32_t*>(section(SEG_TOMBSTONES)); }
+    const uint64_t* bloomWords() const { return reinterpret_cast<const uint64_t*>(section(SEG_BLOOM)); }
+    size_t bloomWordCount() const { return h.bytes[SEG_BLOOM] / sizeof(uint64_t); }
+
+    int32_t id(size_t i) const { return (int32_t)idCol.get(i); }
+    int32_t dateKey(size_t i) const { return (int32_t)dateCol.get(i); }
+    double amount(size_t i) const { return amountCol.getDouble(i); }
+
+    // Row index of id by binary search, or -1
+    long findId(int32_t target) const {
+        bool permuted = h.bytes[SEG_ID_ORDER] > 0;
+        size_t lo = 0, hi = h.rowCount;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (id(permuted ? idOrderCol.get(mid) : mid) < target) lo = mid + 1;
+            else hi = mid;
+        }
+        if (lo == h.rowCount) return -1;
+        size_t row = permuted ? idOrderCol.get(lo) : lo;
+        return id(row) == target ? (long)row : -1;
+    }
+
+    // Appends the rows matching q for which visible(id) holds; returns the
+    // rows examined. Filter columns are decoded a chunk at a time; keyword
+    // and type are tested once per dictionary entry, a category filter
+    // skips whole runs of other categories when that column is run-length
+    // encoded, and a date range on a date-sorted segment is found by
+    // binary search.
+    template <typename Visible>
+    size_t scan(const Query& q, vector<Transaction>& out, Visible visible) const {
+        vector<char> descOk, typeOk;
+        if (!q.keyword.empty()) {
+            descOk.resize(descDict.size());
+            for (size_t d = 0; d < descDict.size(); ++d) descOk[d] = descDict[d].find(q.keyword) != string_view::npos;
+        }
+        if (!q.type.empty()) {
+            typeOk.resize(labels.size());
+            for (size_t l = 0; l < labels.size(); ++l) typeOk[l] = labels[l] == q.type;
+        }
+        int64_t category = -1;
+        if (!q.category.empty()) {
+            for (uint32_t c = 0; c < h.categoryCount; ++c) {
+                if (labels[categoryCodes[c]] == q.category) category = categoryCodes[c];
+            }
+            if (category < 0) return 0;
+        }
+        int32_t lo = q.start.key(), hi = q.end.key();
+
+        size_t first = 0, last = h.rowCount;
+        if (q.hasDateRange && (h.flags & SEGMENT_BY_DATE)) {
+            auto bound = [this](size_t from, int32_t key, bool upper) {
+                size_t a = from, b = h.rowCount;
+                while (a < b) {
+                    size_t mid = (a + b) / 2;
+                    int32_t at = dateKey(mid);
+                    if (at < key || (upper && at == key)) a = mid + 1;
+                    else b = mid;
+                }
+                return a;
+            };
+            first = bound(0, lo, false);
+            last = bound(first, hi, true);
+        }
+
+        // Each filter narrows a selection of chunk rows; a column is decoded
+        // only while some row of the chunk is still selected
+        vector<int64_t> values(SCAN_CHUNK);
+        vector<double> amounts(SCAN_CHUNK);
+        vector<int64_t> chunk[5];      // id, date, category, type, description
+        for (auto& column : chunk) column.resize(SCAN_CHUNK);
+        vector<uint32_t> selected(SCAN_CHUNK);
+        auto testRange = [&](size_t begin, size_t end, bool checkCategory) {
+            for (size_t base = begin; base < end; base += SCAN_CHUNK) {
+                size_t n = min(SCAN_CHUNK, end - base), m = n;
+                for (size_t i = 0; i < n; ++i) selected[i] = i;
+                auto narrow = [&](bool needed, const ColumnReader& col, auto keep) {
+                    if (!needed || m == 0) return;
+                    col.decode(base, n, values.data());
+                    size_t k = 0;
+                    for (size_t j = 0; j < m; ++j) {
+                        selected[k] = selected[j];
+                        k += keep(values[selected[j]]);
+                    }
+                    m = k;
+                };
+                narrow(q.hasDateRange, dateCol, [lo, hi](int64_t d) { return d >= lo && d <= hi; });
+                narrow(checkCategory, catCol, [category](int64_t c) { return c == category; });
+                narrow(!typeOk.empty(), typeCol, [&typeOk](int64_t t) { return typeOk[t] != 0; });
+                narrow(!descOk.empty(), descCol, [&descOk](int64_t d) { return descOk[d] != 0; });
+                if (q.hasAmountRange && m > 0) {
+                    amountCol.decodeDoubles(base, n, amounts.data());
+                    size_t k = 0;
+                    for (size_t j = 0; j < m; ++j) {
+                        double a = amounts[selected[j]];
+                        selected[k] = selected[j];
+                        k += a >= q.minAmount && a <= q.maxAmount;
+                    }
+                    m = k;
+                }
+                if (m * 8 < n) {
+                    for (size_t j = 0; j < m; ++j) {
+                        if (visible(id(base + selected[j]))) out.push_back(row(base + selected[j]));
+                    }
+                    continue;
+                }
+                // Dense matches: decode the whole chunk instead of each row's values
+                idCol.decode(base, n, chunk[0].data());
+                dateCol.decode(base, n, chunk[1].data());
+                catCol.decode(base, n, chunk[2].data());
+                typeCol.decode(base, n, chunk[3].data());
+                descCol.decode(base, n, chunk[4].data());
+                amountCol.decodeDoubles(base, n, amounts.data());
+                for (size_t j = 0; j < m; ++j) {
+                    uint32_t i = selected[j];
+                    if (!visible((int32_t)chunk[0][i])) continue;
+                    out.push_back({(int)chunk[0][i], Date::fromKey(chunk[1][i]), labels[chunk[2][i]], amounts[i],
+                                   descDict[chunk[4][i]], labels[chunk[3][i]]});
+                }
+            }
+            return end - begin;
+        };
+        if (first >= last) return 0;
+        if (category < 0 || catCol.encoding() != COL_RLE) return testRange(first, last, category >= 0);
+        size_t visited = 0;
+        catCol.forEachRun(first, last, [&](size_t begin, size_t end, int64_t value) {
+            if (value == category) visited += testRange(begin, end, false);
+        });
+        return visited;
+    }
+
+    // Adds each label's amount total and row count to totals (indexed by
+    // label code), grouping by the category or the type column. A
+    // run-length encoded group column is summed a run at a time straight
+    // from the packed amounts; otherwise both columns are decoded a chunk at
+    // a time and amounts in cents are summed as integers.
+    void groupTotals(bool byCategory, vector<pair<double, size_t>>& totals) const {
+        const ColumnReader& group = byCategory ? catCol : typeCol;
+        totals.resize(max(totals.size(), labels.size()));
+        if (group.encoding() == COL_RLE) {
+            group.forEachRun(0, h.rowCount, [&](size_t begin, size_t end, int64_t label) {
+                totals[label].first += amountCol.sumDouble(begin, end);
+                totals[label].second += end - begin;
+            });
+            return;
+        }
+        bool exact = amountCol.encoding() != COL_DOUBLE;
+        vector<int64_t> cents(labels.size());
+        vector<int64_t> codes(SCAN_CHUNK), values(SCAN_CHUNK);
+        for (size_t base = 0; base < h.rowCount; base += SCAN_CHUNK) {
+            size_t n = min<size_t>(SCAN_CHUNK, h.rowCount - base);
+            group.decode(base, n, codes.data());
+            if (exact) {
+                amountCol.decode(base, n, values.data());
+                for (size_t i = 0; i < n; ++i) cents[codes[i]] += values[i];
+            } else {
+                for (size_t i = 0; i < n; ++i) totals[codes[i]].first += amountCol.getDouble(base + i);
+            }
+            for (size_t i = 0; i < n; ++i) ++totals[codes[i]].second;
+        }
+        if (exact) {
+            for (size_t l = 0; l < labels.size(); ++l) totals[l].first += (double)cents[l] / 100;
+        }
+    }
+
+    const SegmentHeader& header() const { return h; }
+    uint32_t rowCount() const { return h.rowCount; }
+    size_t fileBytes() const { return file.size(); }
+    const vector<string_view>& labelDictionary() const { return labels; }
+    const vector<string_view>& descDictionary() const { return descDict; }
+
+    vector<string_view> categories() const {
+        vector<string_view> out;
+        for (uint32_t c = 0; c < h.categoryCount; ++c) out.push_back(labels[categoryCodes[c]]);
+        return out;
+    }
+
+    Transaction row(size_t i) const {
+        return {id(i), Date::fromKey(dateKey(i)), labels[catCol.get(i)], amount(i), descDict[descCol.get(i)],
+                labels[typeCol.get(i)]};
+    }
+};
+
+// Buffer manager: keeps recently used segments mapped within a byte budget
+// and unmaps the least recently used ones beyond it. A segment still held
+// by a caller (a pin) is never unmapped; the budget may be exceeded while
+// pins are outstanding.
+class SegmentCache {
+private:
+    struct Entry {
+        shared_ptr<const Segment> segment;
+        list<size_t>::iterator lru;
+    };
+    size_t budget;
+    size_t resident = 0;
+    list<size_t> lru;                        // most recent first
+    unordered_map<size_t, Entry> entries;
+
+    void evict() {
+        for (auto it = lru.end(); resident > budget && it != lru.begin();) {
+            --it;
+            Entry& e = entries[*it];
+            if (e.segment.use_count() > 1) continue;     // pinned
+            resident -= e.segment->fileBytes();
+            ++evictions;
+            entries.erase(*it);
+            it = lru.erase(it);
+        }
+    }
+
+public:
+    size_t hits = 0, misses = 0, evictions = 0;
+
+    explicit SegmentCache(size_t budgetBytes) : budget(budgetBytes) {}
+
+    // The segment for key, loaded by load() on a miss (nullptr if that fails)
+    template <typename Load>
+    shared_ptr<const Segment> pin(size_t key, Load load) {
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            ++hits;
+            lru.splice(lru.begin(), lru, it->second.lru);
+            shared_ptr<const Segment> segment = it->second.segment;
+            evict();     // pins released since the last miss may have freed room
+            return segment;
+        }
+        ++misses;
+        shared_ptr<const Segment> segment = load();
+        if (!segment) return nullptr;
+        lru.push_front(key);
+        entries[key] = {segment, lru.begin()};
+        resident += segment->fileBytes();
+        evict();
+        return segment;
+    }
+
+    void setBudget(size_t bytes) {
+        budget = bytes;
+        evict();
+    }
+
+    size_t residentBytes() const { return resident; }
+    size_t residentCount() const { return entries.size(); }
+    size_t budgetBytes() const { return budget; }
+};
+
+// What a segment scan did; skipped segments were never mapped
+struct SegmentScanStats {
+    size_t segments = 0;
+    size_t skippedByZoneMap = 0;
+    size_t skippedByCategory = 0;
+    size_t rowsScanned = 0;
+};
+
+// Rows point into the pinned segments, which stay mapped as long as the
+// result is alive
+struct SegmentResult {
+    vector<Transaction> rows;
+    vector<shared_ptr<const Segment>> pins;
+    SegmentScanStats stats;
+};
+
+// A directory of segments, queried in file order (export writes them in id order)
+class SegmentStore {
+private:
+    struct SegmentInfo {
+        string path;
+        uint32_t rows;
+        uint64_t fileBytes;
+        ZoneMap zone;
+        vector<string> categories;
+        bool verified = false;     // section checksums checked once per store
+    };
+    string directory;
+    vector<SegmentInfo> catalog;
+    SegmentCache cache;
+    uint64_t totalRows = 0;
+
+    map<string, pair<double, size_t>> groupTotals(bool byCategory) {
+        map<string, pair<double, size_t>> result;
+        vector<pair<double, size_t>> perLabel;
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            shared_ptr<const Segment> segment = pin(i);
+            if (!segment) {
+                cout << "✗ Corrupt segment: " << catalog[i].path << "\n";
+                continue;
+            }
+            perLabel.assign(segment->labelDictionary().size(), {0.0, 0});
+            segment->groupTotals(byCategory, perLabel);
+            for (size_t l = 0; l < perLabel.size(); ++l) {
+                if (perLabel[l].second == 0) continue;
+                auto& total = result[string(segment->labelDictionary()[l])];
+                total.first += perLabel[l].first;
+                total.second += perLabel[l].second;
+            }
+        }
+        return result;
+    }
+
+    shared_ptr<const Segment> pin(size_t i) {
+        SegmentInfo& info = catalog[i];
+        return cache.pin(i, [&info]() -> shared_ptr<const Segment> {
+            auto segment = make_shared<Segment>();
+            if (!segment->open(info.path, !info.verified)) return nullptr;
+            info.verified = true;
+            return segment;
+        });
+    }
+
+public:
+    explicit SegmentStore(size_t cacheBytes = 256 << 20) : cache(cacheBytes) {}
+
+    // Reads the catalog - headers and category lists - of every *.eseg file
+    bool open(const string& dir) {
+        directory = dir;
+        catalog.clear();
+        totalRows = 0;
+        cache = SegmentCache(cache.budgetBytes());
+        error_code ec;
+        vector<string> paths;
+        for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+            if (entry.path().extension() == ".eseg") paths.push_back(entry.path().string());
+        }
+        if (ec) {
+            cout << "✗ Cannot open segment directory: " << dir << "\n";
+            return false;
+        }
+        sort(paths.begin(), paths.end());
+        for (const string& path : paths) {
+            Segment s;
+            if (!s.open(path, false)) {
+                cout << "✗ Corrupt segment: " << path << "\n";
+                return false;
+            }
+            SegmentInfo info;
+            info.path = path;
+            info.rows = s.rowCount();
+            info.fileBytes = s.fileBytes();
+            info.zone = s.header().zone;
+            for (string_view c : s.categories()) info.categories.emplace_back(c);
+            totalRows += info.rows;
+            catalog.push_back(move(info));
+        }
+        cout << "✓ Segment store opened (" << catalog.size() << " segments, " << totalRows << " rows)\n";
+        return true;
+    }
+
+    // Time Complexity: O(segments) to prune + O(rows of the surviving segments).
+    // Filter columns are decoded from their encoded form a chunk at a time,
+    // and runs of a non-matching category are skipped without decoding
+    SegmentResult query(const Query& q) {
+        SegmentResult result;
+        result.stats.segments = catalog.size();
+        for (size_t i = 0; i < catalog.size(); ++i) {
+            const SegmentInfo& info = catalog[i];
+            if (!info.zone.mayMatch(q)) {
+                ++result.stats.skippedByZoneMap;
+                continue;
+            }
+            if (!q.category.empty() && find(info.categories.begin(), info.categories.end(), q.category)
+                                          == info.categories.end()) {
+                ++result.stats.skippedByCategory;
+                continue;
+            }
+            shared_ptr<const Segment> segment = pin(i);
+            if (!segment) {
+                cout << "✗ Corrupt segment: " << info.path << "\n";
+                continue;
+            }
+            size_t before = result.rows.size();
+            result.stats.rowsScanned += segment->scan(q, result.rows, [](int32_t) { return true; });
+            if (result.rows.size() > before) result.pins.push_back(move(segment));
+        }
+        return result;
+    }
+
+    SegmentResult searchByDateRange(const Date& start, const Date& end) {
+        Query q;
+        q.hasDateRange = true;
+        q.start = start;
+        q.end = end;
+        return query(q);
+    }
+
+    SegmentResult searchByAmountRange(double minAmount, double maxAmount) {
+        Query q;
+        q.hasAmountRange = true;
+        q.minAmount = minAmount;
+        q.maxAmount = maxAmount;
+        return query(q);
+    }
+
+    // Time Complexity: O(runs) per segment whose category column is
+    // run-length encoded, otherwise O(rows). Amount total and row count per
+    // category, computed on the encoded columns.
+    map<string, pair<double, size_t>> totalsByCategory() { return groupTotals(true); }
+
+    // Time Complexity: as totalsByCategory, per type
+    map<string, pair<double, size_t>> totalsByType() { return groupTotals(false); }
+
+    size_t segmentCount() const { return catalog.size(); }
+    uint64_t rowCount() const { return totalRows; }
+    uint64_t fileBytes() const {
+        uint64_t total = 0;
+        for (const SegmentInfo& info : catalog) total += info.fileBytes;
+        return total;
+    }
+    SegmentCache& bufferManager() { return cache; }
+
+    void showStats() const {
+        cout << "\n" << string(60, '=') << "\n";
+        cout << "SEGMENT STORE: " << directory << "\n";
+        cout << string(60, '=') << "\n";
+        cout << "Segments: " << catalog.size() << " (" << totalRows << " rows)\n";
+        // Raw columns: id, date, 3 dictionary codes (4 bytes each) and an 8-byte amount
+        uint64_t bytes = fileBytes(), raw = totalRows * 28;
+        cout << "On disk: " << bytes << " bytes (" << fixed << setprecision(1)
+             << (totalRows ? (double)bytes / totalRows : 0.0) << " bytes/row, "
+             << (bytes ? (double)raw / bytes : 0.0) << "x smaller than raw columns)\n";
+        cout << "Resident: " << cache.residentCount() << " segments, " << cache.residentBytes()
+             << " of " << cache.budgetBytes() << " bytes\n";
+        cout << "Cache: " << cache.hits << " hits, " << cache.misses << " misses, "
+             << cache.evictions << " evictions\n\n";
+    }
+};
+
+// ============= WRITE-AHEAD LOG =============
+// File layout: "EXPWAL\0\0" | u32 generation | records...
+// Record: u32 payload length | u32 CRC-32 of (type + payload) | u8 type | payload
+// Replay stops at the first torn or corrupt record; the tail is discarded.
+// WAL_UNDO / WAL_REDO / WAL_RESTORE payload: u32 op count | (u8 op type | row) per op
+enum WalRecordType : uint8_t { WAL_ADD = 1, WAL_DELETE, WAL_UNDO, WAL_REDO, WAL_GROUP_BEGIN, WAL_GROUP_END,
+                               WAL_RESTORE, WAL_UPDATE };
+
+enum SyncPolicy {
+    SYNC_ALWAYS,    // fsync after every record
+    SYNC_BATCHED,   // group commit: fsync once per batch of records or time window
+    SYNC_NONE       // leave flushing to the OS; fsync only on sync() / checkpoint
+};
+
+struct WalOptions {
+    SyncPolicy policy = SYNC_BATCHED;
+    size_t groupCommitOps = 64;        // records per group commit
+    int groupCommitMillis = 10;        // or oldest unsynced record age
+    size_t checkpointEvery = 100000;   // records between automatic checkpoints, 0 = manual
+    // A group commit is submitted and left running while the next records
+    // are appended. While it runs, the next group keeps growing, up to
+    // 4x groupCommitOps, instead of waiting. false waits for every group.
+    bool overlapCommits = true;
+};
+
+static const char WAL_MAGIC[8] = {'E', 'X', 'P', 'W', 'A', 'L', '\0', '\0'};
+static const size_t WAL_HEADER_SIZE = sizeof(WAL_MAGIC) + sizeof(uint32_t);
+
+template <typename T>
+void walPut(vector<char>& out, const T& value) {
+    const char* p = reinterpret_cast<const char*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T walGet(const char*& p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+void walPutString(vector<char>& out, string_view str) {
+    walPut<uint32_t>(out, str.size());
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+// The view points into the log buffer; callers copy it into their arena
+string_view walGetString(const char*& p) {
+    uint32_t len = walGet<uint32_t>(p);
+    string_view str(p, len);
+    p += len;
+    return str;
+}
+
+void walPutRow(vector<char>& out, const Transaction& t) {
+    walPut<int32_t>(out, t.id);
+    walPut<int32_t>(out, t.date.key());
+    walPut<double>(out, t.amount);
+    walPutString(out, t.category);
+    walPutString(out, t.description);
+    walPutString(out, t.type);
+}
+
+Transaction walGetRow(const char*& p) {
+    Transaction t;
+    t.id = walGet<int32_t>(p);
+    t.date = Date::fromKey(walGet<int32_t>(p));
+    t.amount = walGet<double>(p);
+    t.category = walGetString(p);
+    t.description = walGetString(p);
+    t.type = walGetString(p);
+    return t;
+}
+
+class WriteAheadLog {
+private:
+    int fd;
+    uint64_t fileSize;                 // bytes written or in flight
+    string path;
+    WalOptions opts;
+    unique_ptr<IoBackend> io;
+    vector<char> pending;              // encoded records not yet handed to the OS
+    size_t unsyncedRecords;
+    size_t records;                    // since the last truncate
+    bool failed;                       // a write or fsync failed; cleared by truncate()
+    chrono::steady_clock::time_point oldestUnsynced;
+
+    static constexpr size_t STAGING_BUFFERS = 2;
+    static constexpr size_t STAGING_BYTES = 256 << 10;
+
+    // Waits for the batch in flight; a failed write or fsync leaves a hole or
+    // an unsynced tail, so nothing more is written until truncate()
+    bool settle() {
+        if (!io->wait()) failed = true;
+        return !failed;
+    }
+
+    // Copies pending into the registered staging buffers and submits the
+    // writes, plus an fsync when durable. Waits for the previous batch
+    // first, since its buffers are about to be reused.
+    bool writePending(bool durable) {
+        if (pending.empty() && !durable) return !failed;
+        if (!settle()) return false;
+        size_t done = 0;
+        while (true) {
+            for (size_t b = 0; b < io->bufferCount() && done < pending.size(); ++b) {
+                size_t n = min(io->bufferSize(), pending.size() - done);
+                memcpy(io->buffer(b), pending.data() + done, n);
+                io->writeBuffer(fd, b, n, fileSize);
+                fileSize += n;
+                done += n;
+            }
+            if (done == pending.size()) break;
+            io->submit();      // more than the staging buffers hold
+            if (!settle()) return false;
+        }
+        if (durable) io->fsync(fd);
+        io->submit();
+        pending.clear();
+        return true;
+    }
+
+    bool writeHeader(uint32_t generation) {
+        pending.insert(pending.end(), WAL_MAGIC, WAL_MAGIC + sizeof(WAL_MAGIC));
+        walPut<uint32_t>(pending, generation);
+        return writePending(true) && settle();
+    }
+
+    bool openFile(int flags) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_BINARY | flags, 0644);
+        if (fd < 0) return false;
+        struct stat st;
+        fileSize = fstat(fd, &st) == 0 ? st.st_size : 0;
+        return true;
+    }
+
+public:
+    WriteAheadLog() : fd(-1), fileSize(0), unsyncedRecords(0), records(0), failed(false) {}
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        if (fd >= 0) {
+            sync();
+            ::close(fd);
+        }
+    }
+
+    // Opens for appending; a missing or empty file gets a fresh header
+    bool open(const string& walPath, const WalOptions& options, uint32_t generation) {
+        path = walPath;
+        opts = options;
+        io = makeIoBackend(STAGING_BUFFERS, STAGING_BYTES);
+        failed = false;
+        if (!openFile(0)) return false;
+        return fileSize > 0 || writeHeader(generation);
+    }
+
+    // False when the record, or an earlier one, could not be written or
+    // synced; the log then refuses records until truncate()
+    bool append(WalRecordType type, const vector<char>& payload) {
+        if (failed) return false;
+        size_t start = pending.size();
+        walPut<uint32_t>(pending, payload.size());
+        walPut<uint32_t>(pending, 0);
+        pending.push_back(type);
+        pending.insert(pending.end(), payload.begin(), payload.end());
+        uint32_t crc = crc32(pending.data() + start + 8, pending.size() - start - 8);
+        memcpy(pending.data() + start + 4, &crc, sizeof(crc));
+        ++records;
+
+        if (unsyncedRecords++ == 0) oldestUnsynced = chrono::steady_clock::now();
+        switch (opts.policy) {
+        case SYNC_ALWAYS:
+            return sync();
+        case SYNC_BATCHED:
+            if (unsyncedRecords >= opts.groupCommitOps ||
+                chrono::steady_clock::now() - oldestUnsynced >= chrono::milliseconds(opts.groupCommitMillis)) {
+                // The group in flight still owns the staging buffers
+                if (opts.overlapCommits && !io->idle() && unsyncedRecords < 4 * opts.groupCommitOps) break;
+                if (!writePending(true) || (!opts.overlapCommits && !settle())) return false;
+                unsyncedRecords = 0;
+            }
+            break;
+        case SYNC_NONE:
+            if (pending.size() >= (1 << 16)) return writePending(false);
+            break;
+        }
+        return !failed;
+    }
+
+    // Makes every appended record durable; false if that failed
+    bool sync() {
+        if (unsyncedRecords == 0 && pending.empty()) return settle();
+        if (!writePending(true) || !settle()) return false;
+        unsyncedRecords = 0;
+        return true;
+    }
+
+    // Under SYNC_BATCHED, syncs the group once its oldest record has waited
+    // groupCommitMillis. append() only checks the window when the next
+    // record arrives, so a caller must poll this while the log is idle.
+    bool syncIfDue() {
+        if (opts.policy != SYNC_BATCHED || unsyncedRecords == 0 ||
+            chrono::steady_clock::now() - oldestUnsynced < chrono::milliseconds(opts.groupCommitMillis))
+            return !failed;
+        return sync();
+    }
+
+    // Drops every record and starts a new generation (after a checkpoint).
+    // A failed log is usable again once this succeeds.
+    bool truncate(uint32_t generation) {
+        io->wait();
+        pending.clear();
+        unsyncedRecords = 0;
+        records = 0;
+        failed = false;
+        ::close(fd);
+        if (!openFile(O_TRUNC)) {
+            failed = true;
+            return false;
+        }
+        return writeHeader(generation);
+    }
+    size_t recordsSinceTruncate() const { return records; }
+    bool healthy() const { return !failed; }
+    const string& filePath() const { return path; }
+    const WalOptions& options() const { return opts; }
+
+    // Feeds every intact record of the given generation or newer to apply.
+    // Returns false if the file is unreadable; torn tails are cut off.
+    static bool replay(const string& walPath, uint32_t minGeneration, size_t& applied,
+                       const function<void(WalRecordType, const char*, size_t)>& apply) {
+        applied = 0;
+        error_code ec;
+        if (!filesystem::exists(walPath, ec) || filesystem::file_size(walPath, ec) == 0) return true;
+
+        size_t valid = 0, size = 0;
+        {
+            MappedFile file;
+            if (!file.open(walPath)) return false;
+            size = file.size();
+            const char* base = file.data();
+            uint32_t generation = 0;
+            if (size >= WAL_HEADER_SIZE && memcmp(base, WAL_MAGIC, sizeof(WAL_MAGIC)) == 0) {
+                memcpy(&generation, base + sizeof(WAL_MAGIC), sizeof(generation));
+                valid = WAL_HEADER_SIZE;
+            }
+            // A log older than the snapshot was already folded in by a checkpoint
+            bool stale = valid == 0 || generation < minGeneration;
+            while (!stale && valid + 9 <= size) {
+                uint32_t len, crc;
+                memcpy(&len, base + valid, sizeof(len));
+                memcpy(&crc, base + valid + 4, sizeof(crc));
+                if (valid + 9 + len > size || crc32(base + valid + 8, len + 1) != crc) break;
+                apply(static_cast<WalRecordType>(base[valid + 8]), base + valid + 9, len);
+                valid += 9 + len;
+                ++applied;
+            }
+            if (stale) valid = 0;
+        }
+        if (valid < size) filesystem::resize_file(walPath, valid, ec);
+        return !ec;
+    }
+};
+
+// ============= LSM STORAGE ENGINE =============
+// A write-optimized ledger. addTransaction logs the row to the memtable's
+// WAL and inserts it into the memtable, an in-memory map sorted by
+// (date, id). A full memtable is frozen and a background thread flushes it
+// to a run: an immutable segment file, date-sorted, with a bloom filter
+// over its ids. A delete of a row that lives in an older memtable or run
+// records a tombstone that hides it until compaction merges both away.
+// Runs are tiered by size. Once tierFanout adjacent runs share a tier, the
+// background thread merges them into one run of the next tier.
+// Files: wal-<seq>.log per memtable, run-<first>-<last>.eseg per run, where
+// first..last are the memtable sequence numbers the run covers.
+struct LsmOptions {
+    size_t memtableRows = 1 << 16;      // rows + tombstones before a memtable is frozen
+    size_t maxImmutableMemtables = 4;   // writers stall while this many await a flush
+    size_t tierFanout = 4;              // runs per tier before they are merged
+    size_t bloomBitsPerKey = 10;        // about 1% false positives
+    WalOptions wal;
+};
+
+// What the background thread has done since open
+struct LsmStats {
+    size_t flushes = 0;
+    size_t merges = 0;
+    size_t rowsMerged = 0;
+    size_t rowsPurged = 0;              // deleted rows dropped by merges
+    size_t tombstonesPurged = 0;
+};
+
+// Rows point into the pinned runs and memtables, which stay alive as long
+// as the result is
+struct LsmResult {
+    vector<Transaction> rows;           // sorted by (date, id)
+    vector<shared_ptr<const void>> pins;
+    SegmentScanStats stats;             // segments = runs
+};
+
+class LsmLedger {
+private:
+    struct Memtable {
+        uint64_t seq = 0;
+        StringArena arena;
+        map<pair<int32_t, int32_t>, Transaction> rows;    // (date key, id) -> row
+        unordered_map<int32_t, int32_t> dateOf;           // id -> date key
+        set<int32_t> tombstones;                          // ids deleted in older sources
+        int nextId = 0;                                   // ledger's next id when frozen
+        unique_ptr<WriteAheadLog> wal;                    // released once frozen
+
+        size_t entries() const { return rows.size() + tombstones.size(); }
+    };
+
+    struct Run {
+        uint64_t firstSeq, lastSeq;
+        string path;
+        shared_ptr<const Segment> segment;
+    };
+
+    string directory;
+    LsmOptions opts;
+    int nextId = 1;
+    uint64_t nextSeq = 1;
+    shared_ptr<Memtable> active;        // only touched by the caller's thread
+    vector<char> walScratch;
+
+    // Guarded by mu. Only the background thread changes runs, so it may
+    // read them without the lock.
+    mutable mutex mu;
+    condition_variable work, progress;
+    deque<shared_ptr<Memtable>> immutables;      // oldest first
+    vector<Run> runs;                             // oldest first, seq ranges disjoint
+    bool stopping = false;
+    bool busy = false;
+    LsmStats counters;
+    unique_ptr<IoBackend> runIo;                  // background thread only, made on first use
+    thread background;
+
+    size_t lookups = 0, bloomSkips = 0;
+
+    string walPath(uint64_t seq) const { return directory + "/wal-" + to_string(seq) + ".log"; }
+
+    string runPath(uint64_t first, uint64_t last) const {
+        return directory + "/run-" + to_string(first) + "-" + to_string(last) + ".eseg";
+    }
+
+    size_t tierOf(const Run& run) const {
+        size_t size = run.segment->rowCount() + run.segment->header().tombstoneCount;
+        size_t tier = 0;
+        for (size_t cap = opts.memtableRows * opts.tierFanout; size >= cap; cap *= opts.tierFanout) ++tier;
+        return tier;
+    }
+
+    static bool hasTombstone(const Segment& s, int32_t id) {
+        const int32_t* t = s.tombstones();
+        return binary_search(t, t + s.header().tombstoneCount, id);
+    }
+
+    // An empty memtable with its log open, or null
+    shared_ptr<Memtable> newMemtable(uint64_t seq) {
+        auto m = make_shared<Memtable>();
+        m->seq = seq;
+        m->wal = make_unique<WriteAheadLog>();
+        if (!m->wal->open(walPath(seq), opts.wal, (uint32_t)seq)) {
+            cout << "✗ Cannot open memtable log: " << walPath(seq) << "\n";
+            // A torn header would make a retry append to a log replay rejects
+            m->wal.reset();
+            error_code ec;
+            filesystem::remove(walPath(seq), ec);
+            return nullptr;
+        }
+        return m;
+    }
+
+    bool startMemtable(uint64_t seq) {
+        shared_ptr<Memtable> m = newMemtable(seq);
+        if (!m) return false;
+        active = move(m);
+        return true;
+    }
+
+    // Logs walScratch before the memtable is touched, so a mutation the log
+    // refuses is not applied at all
+    bool appendLog(WalRecordType type) {
+        if (active->wal->append(type, walScratch)) return true;
+        cout << "✗ Cannot write memtable log: " << active->wal->filePath() << "\n";
+        return false;
+    }
+
+    static void memtableAdd(Memtable& m, const Transaction& row) {
+        Transaction t = row;
+        t.category = m.arena.intern(row.category);
+        t.type = m.arena.intern(row.type);
+        t.description = m.arena.copy(row.description);
+        m.rows.emplace(make_pair(t.date.key(), t.id), t);
+        m.dateOf[t.id] = t.date.key();
+    }
+
+    // A row added to this memtable is erased outright; any other id gets a tombstone
+    static void memtableDelete(Memtable& m, int32_t id) {
+        auto it = m.dateOf.find(id);
+        if (it == m.dateOf.end()) {
+            m.tombstones.insert(id);
+            return;
+        }
+        m.rows.erase({it->second, id});
+        m.dateOf.erase(it);
+    }
+
+    // 1 = row found, 0 = deleted here, -1 = not in this memtable
+    static int probe(const Memtable& m, int32_t id, Transaction& out) {
+        if (m.tombstones.count(id)) return 0;
+        auto it = m.dateOf.find(id);
+        if (it == m.dateOf.end()) return -1;
+        out = m.rows.at({it->second, id});
+        return 1;
+    }
+
+    // Hands the active memtable to the background thread and starts a new
+    // one. The new log is opened first: if that fails nothing is handed off
+    // and the active memtable keeps taking writes. A log that cannot be
+    // synced is still handed off, since the flush to a run is what makes
+    // its rows durable then.
+    bool freeze() {
+        shared_ptr<Memtable> next = newMemtable(nextSeq);
+        if (!next) return false;
+        ++nextSeq;
+        if (!active->wal->sync()) {
+            cout << "✗ Cannot write memtable log: " << active->wal->filePath()
+                 << " (its rows are durable once the memtable is flushed)\n";
+        }
+        active->wal.reset();
+        active->nextId = nextId;
+        {
+            unique_lock<mutex> lock(mu);
+            progress.wait(lock, [this] { return immutables.size() < opts.maxImmutableMemtables; });
+            immutables.push_back(active);
+        }
+        work.notify_one();
+        active = move(next);
+        return true;
+    }
+
+    // A full memtable is frozen before the next mutation rather than after
+    // the last one, so a failed freeze means that mutation is not applied
+    bool makeRoom() {
+        return active->entries() < opts.memtableRows || freeze();
+    }
+
+    // The tiered merge to run next: [first, first + tierFanout), or -1
+    long pickMerge() const {
+        for (size_t i = 0; i + opts.tierFanout <= runs.size(); ++i) {
+            size_t tier = tierOf(runs[i]), j = i + 1;
+            while (j < i + opts.tierFanout && tierOf(runs[j]) == tier) ++j;
+            if (j == i + opts.tierFanout) return (long)i;
+        }
+        return -1;
+    }
+
+    IoBackend& runBackend() {
+        if (!runIo) runIo = makeIoBackend();
+        return *runIo;
+    }
+
+    bool flushMemtable(const Memtable& m) {
+        vector<Transaction> rows;
+        rows.reserve(m.rows.size());
+        for (const auto& entry : m.rows) rows.push_back(entry.second);
+        SegmentExtras extras;
+        extras.sortedByDate = true;
+        extras.tombstones.assign(m.tombstones.begin(), m.tombstones.end());
+        extras.bloomBitsPerKey = opts.bloomBitsPerKey;
+        extras.nextId = m.nextId;
+        string path = runPath(m.seq, m.seq);
+        auto segment = make_shared<Segment>();
+        if (!writeSegment(path, rows.data(), rows.size(), runBackend(), extras) || !segment->open(path, false)) {
+            cout << "✗ Memtable flush failed: " << path << "\n";
+            return false;
+        }
+        {
+            lock_guard<mutex> lock(mu);
+            runs.push_back({m.seq, m.seq, path, move(segment)});
+            immutables.pop_front();
+            ++counters.flushes;
+        }
+        error_code ec;
+        filesystem::remove(walPath(m.seq), ec);
+        return true;
+    }
+
+    // Merges runs [first, first + tierFanout) into one. A tombstone whose row
+    // is among the inputs drops both; when the oldest run takes part, no
+    // older row is left to hide and every tombstone goes.
+    bool mergeRuns(size_t first) {
+        size_t count = opts.tierFanout;
+        bool bottom = first == 0;
+        unordered_set<int32_t> deleted;
+        SegmentExtras extras;
+        extras.sortedByDate = true;
+        extras.bloomBitsPerKey = opts.bloomBitsPerKey;
+        size_t total = 0;
+        for (size_t i = first; i < first + count; ++i) {
+            const Segment& s = *runs[i].segment;
+            deleted.insert(s.tombstones(), s.tombstones() + s.header().tombstoneCount);
+            extras.nextId = max(extras.nextId, s.header().nextId);
+            total += s.rowCount();
+        }
+
+        // k-way merge on (date, id); every input is already in that order
+        using Cursor = tuple<int32_t, int32_t, size_t, size_t>;    // date, id, input, row
+        priority_queue<Cursor, vector<Cursor>, greater<Cursor>> heap;
+        for (size_t i = first; i < first + count; ++i) {
+            const Segment& s = *runs[i].segment;
+            if (s.rowCount() > 0) heap.emplace(s.dateKey(0), s.id(0), i, 0);
+        }
+        vector<Transaction> rows;
+        rows.reserve(total);
+        unordered_set<int32_t> consumed;
+        while (!heap.empty()) {
+            auto [date, id, input, row] = heap.top();
+            heap.pop();
+            const Segment& s = *runs[input].segment;
+            if (row + 1 < s.rowCount()) heap.emplace(s.dateKey(row + 1), s.id(row + 1), input, row + 1);
+            if (deleted.count(id)) consumed.insert(id);
+            else rows.push_back(s.row(row));
+            (void)date;
+        }
+        if (!bottom) {
+            for (int32_t id : deleted) {
+                if (!consumed.count(id)) extras.tombstones.push_back(id);
+            }
+            sort(extras.tombstones.begin(), extras.tombstones.end());
+        }
+
+        uint64_t firstSeq = runs[first].firstSeq, lastSeq = runs[first + count - 1].lastSeq;
+        string path = runPath(firstSeq, lastSeq);
+        auto segment = make_shared<Segment>();
+        if (!writeSegment(path, rows.data(), rows.size(), runBackend(), extras) || !segment->open(path, false)) {
+            cout << "✗ Run merge failed: " << path << "\n";
+            return false;
+        }
+        vector<string> inputs;
+        {
+            lock_guard<mutex> lock(mu);
+            for (size_t i = first; i < first + count; ++i) inputs.push_back(runs[i].path);
+            runs.erase(runs.begin() + first, runs.begin() + first + count);
+            runs.insert(runs.begin() + first, {firstSeq, lastSeq, path, move(segment)});
+            ++counters.merges;
+            counters.rowsMerged += rows.size();
+            counters.rowsPurged += consumed.size();
+            counters.tombstonesPurged += deleted.size() - extras.tombstones.size();
+        }
+        // Readers still holding an input keep its mapping after the unlink
+        error_code ec;
+        for (const string& input : inputs) filesystem::remove(input, ec);
+        return true;
+    }
+
+    // Flushes frozen memtables first, then runs merges until none is due
+    void backgroundLoop() {
+        unique_lock<mutex> lock(mu);
+        while (true) {
+            work.wait(lock, [this] { return stopping || !immutables.empty() || pickMerge() >= 0; });
+            if (stopping) break;
+            busy = true;
+            bool ok;
+            if (!immutables.empty()) {
+                shared_ptr<Memtable> m = immutables.front();
+                lock.unlock();
+                ok = flushMemtable(*m);
+            } else {
+                size_t first = pickMerge();
+                lock.unlock();
+                ok = mergeRuns(first);
+            }
+            lock.lock();
+            busy = false;
+            progress.notify_all();
+            // A failed flush or merge is retried on the next wakeup rather than spun on
+            if (!ok) progress.wait_for(lock, chrono::seconds(1), [this] { return stopping; });
+        }
+        busy = false;
+        progress.notify_all();
+    }
+
+    void stopBackground() {
+        if (!background.joinable()) return;
+        {
+            lock_guard<mutex> lock(mu);
+            stopping = true;
+        }
+        work.notify_all();
+        progress.notify_all();
+        background.join();
+    }
+
+    // Runs a file name describes, or false for any other file
+    static bool parseRunName(const string& name, uint64_t& first, uint64_t& last) {
+        unsigned long long a, b;
+        int used = 0;
+        if (sscanf(name.c_str(), "run-%llu-%llu.eseg%n", &a, &b, &used) != 2 || used != (int)name.size()) return false;
+        first = a;
+        last = b;
+        return first <= last;
+    }
+
+public:
+    LsmLedger() = default;
+    LsmLedger(const LsmLedger&) = delete;
+    LsmLedger& operator=(const LsmLedger&) = delete;
+
+    // Frozen memtables not yet flushed are replayed from their logs on the next open
+    ~LsmLedger() {
+        stopBackground();
+        if (active && active->wal) active->wal->sync();
+    }
+
+    // Opens or creates the ledger in dir. A run that a later merge covers
+    // (left behind by a crash) is removed, as is the log of any flushed
+    // memtable; every other log is replayed into a memtable.
+    bool open(const string& dir, const LsmOptions& options = LsmOptions()) {
+        stopBackground();
+        directory = dir;
+        opts = options;
+        opts.tierFanout = max<size_t>(2, opts.tierFanout);
+        opts.memtableRows = max<size_t>(1, opts.memtableRows);
+        opts.maxImmutableMemtables = max<size_t>(1, opts.maxImmutableMemtables);
+        active.reset();
+        immutables.clear();
+        runs.clear();
+        counters = LsmStats();
+        stopping = false;
+        nextId = 1;
+        nextSeq = 1;
+
+        error_code ec;
+        filesystem::create_directories(dir, ec);
+        vector<Run> found;
+        vector<uint64_t> logs;
+        for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+            string name = entry.path().filename().string();
+            uint64_t first, last;
+            unsigned long long seq;
+            int used = 0;
+            if (parseRunName(name, first, last)) {
+                found.push_back({first, last, entry.path().string(), nullptr});
+            } else if (sscanf(name.c_str(), "wal-%llu.log%n", &seq, &used) == 1 && used == (int)name.size()) {
+                logs.push_back(seq);
+            } else if (entry.path().extension() == ".tmp") {
+                filesystem::remove(entry.path(), ec);     // an interrupted flush or merge
+            }
+        }
+        if (ec) {
+            cout << "✗ Cannot open LSM directory: " << dir << "\n";
+            return false;
+        }
+
+        // Widest range first, so a covered run is always seen after its cover
+        sort(found.begin(), found.end(), [](const Run& a, const Run& b) {
+            return a.firstSeq != b.firstSeq ? a.firstSeq < b.firstSeq : a.lastSeq > b.lastSeq;
+        });
+        uint64_t maxRunSeq = 0;
+        for (Run& run : found) {
+            if (run.lastSeq <= maxRunSeq) {
+                filesystem::remove(run.path, ec);
+                continue;
+            }
+            auto segment = make_shared<Segment>();
+            if (!segment->open(run.path, true) || !(segment->header().flags & SEGMENT_BY_DATE)) {
+                cout << "✗ Corrupt run: " << run.path << "\n";
+                return false;
+            }
+            run.segment = move(segment);
+            maxRunSeq = run.lastSeq;
+            nextId = max(nextId, run.segment->header().nextId);
+            runs.push_back(move(run));
+        }
+
+        sort(logs.begin(), logs.end());
+        for (uint64_t seq : logs) {
+            if (seq <= maxRunSeq) {
+                filesystem::remove(walPath(seq), ec);
+                continue;
+            }
+            auto m = make_shared<Memtable>();
+            m->seq = seq;
+            size_t applied;
+            bool ok = WriteAheadLog::replay(walPath(seq), 0, applied, [&](WalRecordType type, const char* p, size_t) {
+                if (type == WAL_ADD) {
+                    Transaction t = walGetRow(p);
+                    memtableAdd(*m, t);
+                    nextId = max(nextId, t.id + 1);
+                } else if (type == WAL_DELETE) {
+                    memtableDelete(*m, walGet<int32_t>(p));
+                }
+            });
+            if (!ok) {
+                cout << "✗ Cannot replay memtable log: " << walPath(seq) << "\n";
+                return false;
+            }
+            m->nextId = nextId;
+            immutables.push_back(move(m));
+        }
+        if (!immutables.empty()) {
+            // The newest log keeps taking writes
+            active = immutables.back();
+            immutables.pop_back();
+            active->wal = make_unique<WriteAheadLog>();
+            if (!active->wal->open(walPath(active->seq), opts.wal, (uint32_t)active->seq)) {
+                cout << "✗ Cannot open memtable log: " << walPath(active->seq) << "\n";
+                return false;
+            }
+            nextSeq = active->seq + 1;
+        } else {
+            nextSeq = maxRunSeq + 1;
+            if (!startMemtable(nextSeq++)) return false;
+        }
+        background = thread(&LsmLedger::backgroundLoop, this);
+        work.notify_one();
+        cout << "✓ LSM ledger opened (" << runs.size() << " runs, " << immutables.size() + 1
+             << " memtables)\n";
+        return true;
+    }
+
+    // Time Complexity: O(log m) - WAL append + memtable insert; a full memtable
+    // is handed to the background thread. Returns the new transaction's id,
+    // or 0 when the amount is invalid or the log could not be written.
+    int addTransaction(const Date& date, string_view category, double amount,
+                       string_view desc, string_view type) {
+        if (!validAmount(amount)) {
+            cout << "✗ Invalid amount.\n";
+            return 0;
+        }
+        if (!makeRoom()) return 0;
+        Transaction t{nextId, date, category, amount, desc, type};
+        walScratch.clear();
+        walPutRow(walScratch, t);
+        if (!appendLog(WAL_ADD)) return 0;
+        ++nextId;
+        memtableAdd(*active, t);
+        return t.id;
+    }
+
+    // Time Complexity: O(log m) when the row is in the memtable, otherwise
+    // one lookup() to confirm it exists before writing a tombstone
+    bool deleteTransaction(int id) {
+        if (!makeRoom()) return false;
+        if (!active->dateOf.count(id)) {
+            Transaction t;
+            if (!lookup(id, t)) {
+                cout << "✗ Transaction ID not found.\n";
+                return false;
+            }
+        }
+        walScratch.clear();
+        walPut<int32_t>(walScratch, id);
+        if (!appendLog(WAL_DELETE)) return false;
+        memtableDelete(*active, id);
+        return true;
+    }
+
+    // Time Complexity: O(sources) bloom probes + O(log n) per run that may hold id.
+    // Sources are searched newest first; a tombstone ends the search. The
+    // row's strings stay valid until the next mutation.
+    bool lookup(int id, Transaction& out) {
+        ++lookups;
+        int found = probe(*active, id, out);
+        if (found >= 0) return found;
+        lock_guard<mutex> lock(mu);
+        for (auto it = immutables.rbegin(); it != immutables.rend(); ++it) {
+            found = probe(**it, id, out);
+            if (found >= 0) return found;
+        }
+        for (auto it = runs.rbegin(); it != runs.rend(); ++it) {
+            const Segment& s = *it->segment;
+            if (!BloomFilter::mayContain(s.bloomWords(), s.bloomWordCount(), s.header().bloomHashes, id)) {
+                ++bloomSkips;
+                continue;
+            }
+            if (hasTombstone(s, id)) return false;
+            long row = s.findId(id);
+            if (row >= 0) {
+                out = s.row(row);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Time Complexity: O(m) per memtable (O(log m + k) with a date range)
+    // + O(runs) to prune + O(rows of the surviving runs)
+    LsmResult query(const Query& q) {
+        LsmResult result;
+        vector<shared_ptr<Memtable>> memtables{active};
+        vector<Run> snapshot;
+        {
+            lock_guard<mutex> lock(mu);
+            memtables.insert(memtables.end(), immutables.rbegin(), immutables.rend());
+            snapshot.assign(runs.rbegin(), runs.rend());
+        }
+        result.stats.segments = snapshot.size();
+
+        // Tombstones of every newer source hide the rows they deleted
+        unordered_set<int32_t> hidden;
+        auto visible = [&hidden](int32_t id) { return !hidden.count(id); };
+        for (const auto& m : memtables) {
+            size_t before = result.rows.size();
+            auto it = q.hasDateRange ? m->rows.lower_bound({q.start.key(), INT32_MIN}) : m->rows.begin();
+            for (; it != m->rows.end(); ++it) {
+                if (q.hasDateRange && it->first.first > q.end.key()) break;
+                ++result.stats.rowsScanned;
+                if (q.matches(it->second) && visible(it->first.second)) result.rows.push_back(it->second);
+            }
+            hidden.insert(m->tombstones.begin(), m->tombstones.end());
+            if (result.rows.size() > before) result.pins.push_back(m);
+        }
+        for (const Run& run : snapshot) {
+            const Segment& s = *run.segment;
+            if (!s.header().zone.mayMatch(q)) {
+                ++result.stats.skippedByZoneMap;
+            } else {
+                size_t before = result.rows.size();
+                result.stats.rowsScanned += s.scan(q, result.rows, visible);
+                if (result.rows.size() > before) result.pins.push_back(run.segment);
+            }
+            hidden.insert(s.tombstones(), s.tombstones() + s.header().tombstoneCount);
+        }
+        sort(result.rows.begin(), result.rows.end(), [](const Transaction& a, const Transaction& b) {
+            return a.date.key() != b.date.key() ? a.date.key() < b.date.key() : a.id < b.id;
+        });
+        return result;
+    }
+
+    LsmResult searchByDateRange(const Date& start, const Date& end) {
+        Query q;
+        q.hasDateRange = true;
+        q.start = start;
+        q.end = end;
+        return query(q);
+    }
+
+    LsmResult searchByAmountRange(double minAmount, double maxAmount) {
+        Query q;
+        q.hasAmountRange = true;
+        q.minAmount = minAmount;
+        q.maxAmount = maxAmount;
+        return query(q);
+    }
+
+    // Freezes the memtable (if it holds anything) and waits until every
+    // frozen memtable is a run; false if the memtable could not be frozen
+    bool flush() {
+        if (active->entries() > 0 && !freeze()) return false;
+        unique_lock<mutex> lock(mu);
+        progress.wait(lock, [this] { return stopping || immutables.empty(); });
+        return true;
+    }
+
+    // Waits until no flush or merge is pending
+    void waitForCompaction() {
+        unique_lock<mutex> lock(mu);
+        progress.wait(lock, [this] { return stopping || (immutables.empty() && !busy && pickMerge() < 0); });
+    }
+
+    // Makes every mutation so far durable; false if the log could not be synced
+    bool sync() {
+        if (active->wal->sync()) return true;
+        cout << "✗ Cannot write memtable log: " << active->wal->filePath() << "\n";
+        return false;
+    }
+
+    LsmStats stats() const {
+        lock_guard<mutex> lock(mu);
+        return counters;
+    }
+
+    size_t runCount() const {
+        lock_guard<mutex> lock(mu);
+        return runs.size();
+    }
+
+    void showStats() const {
+        lock_guard<mutex> lock(mu);
+        cout << "\n" << string(60, '=') << "\n";
+        cout << "LSM LEDGER: " << directory << "\n";
+        cout << string(60, '=') << "\n";
+        size_t frozen = 0;
+        for (const auto& m : immutables) frozen += m->entries();
+        cout << "Memtable: " << active->rows.size() << " rows, " << active->tombstones.size()
+             << " tombstones (" << immutables.size() << " frozen, " << frozen << " entries)\n";
+        cout << "Runs: " << runs.size() << "\n";
+        for (const Run& run : runs) {
+            cout << "  " << setw(8) << run.firstSeq << "-" << left << setw(8) << run.lastSeq << right
+                 << " tier " << tierOf(run) << "  " << setw(9) << run.segment->rowCount() << " rows  "
+                 << setw(7) << run.segment->header().tombstoneCount << " tombstones\n";
+        }
+        cout << "Background: " << counters.flushes << " flushes, " << counters.merges << " merges ("
+             << counters.rowsMerged << " rows, " << counters.rowsPurged << " deleted rows and "
+             << counters.tombstonesPurged << " tombstones purged)\n";
+        cout << "Lookups: " << lookups << " (" << bloomSkips << " runs skipped by bloom filter)\n\n";
+    }
+};
+
+// ============= CSV IMPORT =============
+// Expected columns: date,category,amount,description,type
+// Dates are d/m/yyyy or yyyy-mm-dd; fields may be double-quoted ("" escapes
+// a quote) but may not contain line breaks, so files can be split on '\n'.
+struct CsvRow {
+    Date date;
+    string_view category, description, type;
+    double amount;
+};
+
+struct ImportResult {
+    size_t rowsRead = 0;
+    size_t rowsImported = 0;
+    size_t rowsRejected = 0;
+    size_t firstBadLine = 0;   // 1-based, 0 when every row was valid
+};
+
+// Splits off the next field; quoted fields are returned without their quotes
+bool csvNextField(string_view& line, string_view& field) {
+    if (!line.empty() && line.front() == '"') {
+        size_t i = 1;
+        while (true) {
+            i = line.find('"', i);
+            if (i == string_view::npos) return false;
+            if (i + 1 < line.size() && line[i + 1] == '"') { i += 2; continue; }
+            break;
+        }
+        field = line.substr(1, i - 1);
+        line.remove_prefix(i + 1);
+        if (!line.empty() && line.front() != ',') return false;
+    } else {
+        size_t comma = line.find(',');
+        field = line.substr(0, comma);
+        line.remove_prefix(comma == string_view::npos ? line.size() : comma);
+    }
+    if (!line.empty()) line.remove_prefix(1);
+    return true;
+}
+
+bool csvParseInt(string_view s, int& value) {
+    auto res = from_chars(s.data(), s.data() + s.size(), value);
+    return res.ec == errc() && res.ptr == s.data() + s.size();
+}
+
+bool csvParseDate(string_view s, Date& d) {
+    char sep = s.find('/') != string_view::npos ? '/' : '-';
+    size_t a = s.find(sep), b = s.find(sep, a == string_view::npos ? a : a + 1);
+    if (a == string_view::npos || b == string_view::npos) return false;
+    int x, y, z;
+    if (!csvParseInt(s.substr(0, a), x) || !csvParseInt(s.substr(a + 1, b - a - 1), y)
+        || !csvParseInt(s.substr(b + 1), z)) return false;
+    d = (sep == '/') ? Date{x, y, z} : Date{z, y, x};
+    return d.isValid();
+}
+
+bool csvParseRow(string_view line, CsvRow& row) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    string_view date, amount;
+    if (!csvNextField(line, date) || !csvNextField(line, row.category) || !csvNextField(line, amount)
+        || !csvNextField(line, row.description) || !csvNextField(line, row.type) || !line.empty()) {
+        return false;
+    }
+    auto res = from_chars(amount.data(), amount.data() + amount.size(), row.amount);
+    if (res.ec != errc() || res.ptr != amount.data() + amount.size()) return false;
+    if (!validAmount(row.amount)) return false;
+    return csvParseDate(date, row.date) && !row.category.empty()
+        && (row.type == "Income" || row.type == "Expense");
+}
+
+// Reads a whole file with one batch of chunked reads; empty on failure
+unique_ptr<char[]> csvReadFile(const string& path, size_t& size, IoBackend& io) {
+    static constexpr size_t READ_CHUNK = 4 << 20;
+    size = 0;
+    int fd = ::open(path.c_str(), O_RDONLY | O_BINARY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    size_t bytes = st.st_size;
+    unique_ptr<char[]> data(new char[bytes]);
+    for (size_t off = 0; off < bytes; off += READ_CHUNK) {
+        io.read(fd, data.get() + off, min(READ_CHUNK, bytes - off), off);
+    }
+    io.submit();
+    bool ok = io.wait();
+    ::close(fd);
+    if (!ok) return nullptr;
+    size = bytes;
+    return data;
+}
+
+// Copies a field out of the file, collapsing "" escapes
+string csvUnescape(string_view field) {
+    string out(field);
+    for (size_t i = out.find("\"\""); i != string::npos; i = out.find("\"\"", i + 1)) out.erase(i, 1);
+    return out;
+}
+
+// ============= MEMORY ACCOUNTING =============
+// Used bytes are what the contents need; reserved bytes are what is
+// actually held, including vector capacity and pool or arena slack.
+struct MemoryComponent {
+    string name;
+    size_t usedBytes = 0;
+    size_t reservedBytes = 0;
+};
+
+struct CategoryMemory {
+    string category;
+    size_t rows = 0;             // ids in the category list, tombstones included
+    size_t liveRows = 0;
+    size_t listBytes = 0;        // capacity of the id list
+    size_t stringBytes = 0;      // descriptions of its live rows
+};
+
+struct MemoryUsage {
+    vector<MemoryComponent> components;
+    vector<CategoryMemory> categories;
+    size_t usedBytes = 0;
+    size_t reservedBytes = 0;
+    size_t undoSpilledBytes = 0; // on disk, not counted above
+};
+
+// ============= ASYNC EXECUTOR =============
+// Awaitable queries and saves need C++20 coroutines; in a C++17 build this
+// section and the async members of ExpenseManager compile away.
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define EXPENSE_HAS_COROUTINES 1
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+template <typename T>
+class Task;
+
+// The promise keeps the coroutine's result and whoever awaits it; on
+// completion control transfers straight to that awaiter.
+template <typename T>
+struct TaskPromiseBase {
+    coroutine_handle<> continuation = noop_coroutine();
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        coroutine_handle<> await_suspend(coroutine_handle<P> h) noexcept {
+            return h.promise().continuation;
+        }
+        void await_resume() noexcept {}
+    };
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { terminate(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase<T> {
+    optional<T> value;
+    Task<T> get_return_object();
+    void return_value(T v) { value = move(v); }
+    T result() { return move(*value); }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase<void> {
+    Task<void> get_return_object();
+    void return_void() {}
+    void result() {}
+};
+
+// A lazily started coroutine; it runs when first awaited and owns its frame
+template <typename T = void>
+class Task {
+public:
+    using promise_type = TaskPromise<T>;
+
+    explicit Task(coroutine_handle<promise_type> h) : handle(h) {}
+    Task(Task&& other) noexcept : handle(exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = exchange(other.handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    coroutine_handle<> await_suspend(coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return handle.promise().result(); }
+
+private:
+    coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Cooperative executor: coroutines resume one at a time on the thread that
+// calls run(), so ledger access needs no lock as long as only this thread
+// touches the ledger. Long scans yield() back to the end of the queue
+// between chunks. Blocking work that doesn't touch the ledger - file
+// writes - goes to helper threads through offload(), and the coroutine
+// resumes on the executor thread once it finishes.
+class AsyncExecutor {
+private:
+    mutex lock;
+    condition_variable wake;         // ready work for run()
+    condition_variable jobReady;     // work for the helpers
+    deque<coroutine_handle<>> ready;
+    deque<function<void()>> jobs;
+    size_t inFlight = 0;             // offloaded jobs not yet resumed
+    bool stopping = false;
+    vector<thread> helpers;
+
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            suspend_never initial_suspend() noexcept { return {}; }
+            suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { terminate(); }
+        };
+    };
+
+    struct Start {
+        AsyncExecutor& executor;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(coroutine_handle<> h) { executor.post(h); }
+        void await_resume() noexcept {}
+    };
+
+    static Detached detach(AsyncExecutor& executor, Task<void> task) {
+        co_await Start{executor};
+        co_await task;
+    }
+
+    void helperLoop() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            jobReady.wait(guard, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+            function<void()> job = move(jobs.front());
+            jobs.pop_front();
+            guard.unlock();
+            job();
+            guard.lock();
+        }
+    }
+
+public:
+    explicit AsyncExecutor(size_t helperThreads = 1) {
+        for (size_t i = 0; i < max<size_t>(helperThreads, 1); ++i) {
+            helpers.emplace_back([this] { helperLoop(); });
+        }
+    }
+
+    ~AsyncExecutor() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (thread& t : helpers) t.join();
+        // Coroutines still queued here were abandoned by their owner
+    }
+
+    AsyncExecutor(const AsyncExecutor&) = delete;
+    AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+    void post(coroutine_handle<> h) {
+        {
+            lock_guard<mutex> guard(lock);
+            ready.push_back(h);
+        }
+        wake.notify_one();
+    }
+
+    // Starts a task that nobody awaits; its frame is freed when it finishes
+    void spawn(Task<void> task) {
+        detach(*this, move(task));
+    }
+
+    // co_await executor.yield() lets every other ready coroutine run first
+    Start yield() {
+        return Start{*this};
+    }
+
+    // co_await executor.offload(f) runs f() on a helper thread and resumes
+    // with its result on the executor thread
+    template <typename F>
+    auto offload(F f) {
+        using R = decltype(f());
+        struct Awaiter {
+            AsyncExecutor& executor;
+            F work;
+            conditional_t<is_void_v<R>, bool, optional<R>> result{};
+
+            bool await_ready() noexcept { return false; }
+            void await_suspend(coroutine_handle<> h) {
+                {
+                    lock_guard<mutex> guard(executor.lock);
+                    ++executor.inFlight;
+                    // Once h is queued the frame holding this awaiter may be
+                    // destroyed, so the job keeps its own executor pointer
+                    executor.jobs.push_back([this, h, ex = &executor] {
+                        if constexpr (is_void_v<R>) work();
+                        else result = work();
+                        {
+                            lock_guard<mutex> guard(ex->lock);
+                            --ex->inFlight;
+                            ex->ready.push_back(h);
+                        }
+                        ex->wake.notify_one();
+                    });
+                }
+                executor.jobReady.notify_one();
+            }
+            R await_resume() {
+                if constexpr (!is_void_v<R>) return move(*result);
+            }
+        };
+        return Awaiter{*this, move(f)};
+    }
+
+    // Resumes ready coroutines until none are queued or offloaded
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this] { return !ready.empty() || inFlight == 0; });
+            if (ready.empty()) return;
+            coroutine_handle<> h = ready.front();
+            ready.pop_front();
+            guard.unlock();
+            h.resume();
+            guard.lock();
+        }
+    }
+
+    // Runs the executor until task completes and returns its result
+    template <typename T>
+    T wait(Task<T> task) {
+        optional<conditional_t<is_void_v<T>, bool, T>> result;
+        spawn([](Task<T> t, auto& out) -> Task<void> {
+            if constexpr (is_void_v<T>) {
+                co_await t;
+                out = true;
+            } else {
+                out = co_await t;
+            }
+        }(move(task), result));
+        run();
+        if constexpr (!is_void_v<T>) return move(*result);
+    }
+};
+#endif
+
+// ============= MATERIALIZED VIEWS =============
+// A view groups the rows that match its filter by a few keys and keeps
+// aggregates of their amounts per group. The manager hands it every row
+// that becomes live or dead, so it never rescans the ledger, and groups
+// stay in key order, so reading one costs only the groups it returns.
+enum GroupKey { GROUP_CATEGORY, GROUP_TYPE, GROUP_YEAR, GROUP_MONTH, GROUP_WEEK, GROUP_DAY };
+enum AggregateFunc { AGG_COUNT, AGG_SUM, AGG_AVG, AGG_MIN, AGG_MAX };
+
+struct ViewDefinition {
+    vector<GroupKey> groupBy;
+    vector<AggregateFunc> aggregates;   // over the amount column
+    Query filter;                       // rows the view covers; matches all by default
+};
+
+struct ViewRow {
+    vector<string> keys;      // one label per groupBy entry
+    vector<double> values;    // one per aggregate
+};
+
+class MaterializedView {
+private:
+    struct Group {
+        vector<string> keys;
+        size_t count = 0;
+        int64_t cents = 0;          // whole-cent amounts, summed exactly
+        double residue = 0;         // amounts with fractional cents
+        map<double, size_t> amounts;    // only kept for MIN/MAX
+    };
+
+    ViewDefinition def;
+    bool tracksExtremes = false;
+    map<string, Group> groups;      // labels joined by KEY_SEPARATOR
+    string scratch;
+    static constexpr char KEY_SEPARATOR = '\x1f';      // sorts below any label character
+
+    // Days since 1970-01-01 in the proleptic Gregorian calendar
+    static int64_t dayNumber(int year, int month, int day) {
+        year -= month <= 2;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t yoe = year - era * 400;
+        int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    }
+
+    static Date fromDayNumber(int64_t z) {
+        z += 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        int64_t doe = z - era * 146097;
+        int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        int64_t mp = (5 * doy + 2) / 153;
+        int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+        int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+        return {day, month, (int)(yoe + era * 400 + (month <= 2))};
+    }
+
+    // Weeks are labelled by their Monday
+    static void appendLabel(string& out, GroupKey key, const Transaction& t) {
+        char buf[16];
+        int n = 0;
+        switch (key) {
+        case GROUP_CATEGORY: out.append(t.category); return;
+        case GROUP_TYPE:     out.append(t.type); return;
+        case GROUP_YEAR:     n = snprintf(buf, sizeof(buf), "%04d", t.date.year); break;
+        case GROUP_MONTH:    n = snprintf(buf, sizeof(buf), "%04d-%02d", t.date.year, t.date.month); break;
+        case GROUP_DAY:
+            n = snprintf(buf, sizeof(buf), "%04d-%02d-%02d", t.date.year, t.date.month, t.date.day);
+            break;
+        case GROUP_WEEK: {
+            int64_t days = dayNumber(t.date.year, t.date.month, t.date.day);
+            Date monday = fromDayNumber(days - ((days + 3) % 7 + 7) % 7);
+            n = snprintf(buf, sizeof(buf), "%04d-%02d-%02d", monday.year, monday.month, monday.day);
+            break;
+        }
+        }
+        out.append(buf, n);
+    }
+
+public:
+    explicit MaterializedView(ViewDefinition definition) : def(move(definition)) {
+        for (AggregateFunc f : def.aggregates) tracksExtremes |= (f == AGG_MIN || f == AGG_MAX);
+    }
+
+    const ViewDefinition& definition() const { return def; }
+    size_t groupCount() const { return groups.size(); }
+    void clear() { groups.clear(); }
+
+    // Adds (sign > 0) or removes (sign < 0) a row's contribution.
+    // Time Complexity: O(log g), plus O(log k) for a view with MIN/MAX
+    void apply(const Transaction& t, int sign) {
+        if (!def.filter.matches(t)) return;
+        scratch.clear();
+        for (size_t i = 0; i < def.groupBy.size(); ++i) {
+            if (i) scratch.push_back(KEY_SEPARATOR);
+            appendLabel(scratch, def.groupBy[i], t);
+        }
+        auto it = groups.find(scratch);
+        if (it == groups.end()) {
+            if (sign < 0) return;
+            it = groups.emplace(scratch, Group()).first;
+            size_t start = 0;
+            for (size_t i = 0; i < def.groupBy.size(); ++i) {
+                size_t end = scratch.find(KEY_SEPARATOR, start);
+                if (end == string::npos) end = scratch.size();
+                it->second.keys.emplace_back(scratch, start, end - start);
+                start = end + 1;
+            }
+        }
+        Group& g = it->second;
+        double scaled = t.amount * 100;
+        if (scaled == nearbyint(scaled) && fabs(scaled) < 9e15) g.cents += sign * (int64_t)scaled;
+        else g.residue += sign * t.amount;
+        if (tracksExtremes) {
+            if (sign > 0) g.amounts[t.amount]++;
+            else {
+                auto a = g.amounts.find(t.amount);
+                if (a != g.amounts.end() && --a->second == 0) g.amounts.erase(a);
+            }
+        }
+        if (sign > 0) ++g.count;
+        else if (--g.count == 0) groups.erase(it);
+    }
+
+    // Time Complexity: O(g) - one row per group, in key order
+    void read(vector<ViewRow>& out) const {
+        out.clear();
+        out.reserve(groups.size());
+        for (const auto& entry : groups) {
+            const Group& g = entry.second;
+            double sum = g.cents / 100.0 + g.residue;
+            ViewRow row;
+            row.keys = g.keys;
+            for (AggregateFunc f : def.aggregates) {
+                switch (f) {
+                case AGG_COUNT: row.values.push_back((double)g.count); break;
+                case AGG_SUM:   row.values.push_back(sum); break;
+                case AGG_AVG:   row.values.push_back(sum / g.count); break;
+                case AGG_MIN:   row.values.push_back(g.amounts.begin()->first); break;
+                case AGG_MAX:   row.values.push_back(g.amounts.rbegin()->first); break;
+                }
+            }
+            out.push_back(move(row));
+        }
+    }
+
+    static const char* keyName(GroupKey key) {
+        static const char* const names[] = {"Category", "Type", "Year", "Month", "Week", "Day"};
+        return names[key];
+    }
+
+    static const char* aggregateName(AggregateFunc f) {
+        static const char* const names[] = {"Count", "Sum", "Avg", "Min", "Max"};
+        return names[f];
+    }
+
+    size_t memoryBytes() const {
+        size_t bytes = 0;
+        for (const auto& entry : groups) {
+            bytes += sizeof(entry) + entry.first.capacity() + 4 * sizeof(void*);
+            for (const string& k : entry.second.keys) bytes += sizeof(string) + k.capacity();
+            bytes += entry.second.amounts.size() * (sizeof(pair<double, size_t>) + 4 * sizeof(void*));
+        }
+        return bytes;
+    }
+};
+
+// ============= EXPENSE MANAGER CLASS =============
+class ExpenseManager {
+private:
+    StringArena strings;                                       // Backing store for every string_view
+    vector<shared_ptr<MappedFile>> pinnedSnapshots;            // Loaded snapshots the views point into
+    CountingResource indexUpstream;                            // Blocks the pool holds, for the memory report
+    pmr::unsynchronized_pool_resource indexPool{&indexUpstream};   // Node pool for the indexes below
+
+    vector<Transaction> transactions;                          // Array for all transactions (slots, in id order)
+    vector<uint64_t> liveBits;                                 // Bit per slot; a cleared bit is a tombstone
+    size_t liveCount = 0;
+    mutable pmr::unordered_map<string_view, pmr::vector<int>> categoryMap{&indexPool};    // Hash Map for categories (ids)
+    UndoJournal undoStack;                                     // Stack for undo operations
+    vector<UndoOp> redoStack;                                  // Undone units, newest at the back
+    vector<UndoOp> unitScratch;                                // Ops of the unit being undone/redone
+    int groupDepth = 0;                                        // Open beginGroup() calls
+    pmr::unordered_set<int> pinnedIds{&indexPool};             // Tombstones an undo or redo can still revive
+    int nextId;
+
+    // Secondary indexes used by the query planner. After load() they are
+    // rebuilt on first use rather than up front. Tombstoned rows keep their
+    // entries until the compactor reclaims them; readers check liveness.
+    mutable vector<uint32_t> slotOf;                               // id -> slot in transactions
+    mutable pmr::set<pair<int, int>> dateIndex{&indexPool};        // (date key, id), also the date keyset order
+    mutable pmr::set<pair<double, int>> amountIndex{&indexPool};   // (amount, id)
+    mutable pmr::map<int, size_t> monthHistogram{&indexPool};      // month key -> live row count
+    mutable bool indexesBuilt = true;
+
+    // Live ids per category, type and month, for filters that combine them.
+    // Unlike the indexes above they drop a row as soon as it dies, so an id
+    // in every selected bitmap is a match without looking at the row.
+    mutable unordered_map<string_view, RoaringBitmap> categoryBitmaps;
+    mutable unordered_map<string_view, RoaringBitmap> typeBitmaps;
+    mutable map<int, RoaringBitmap> monthBitmaps;                  // month key -> ids
+
+    // Registered views, fed by the same liveness and rewrite hooks
+    mutable map<string, MaterializedView> views;
+
+    // Incremental compaction: live rows slide from compactRead down to
+    // compactWrite a few at a time, so no single call pays for a full pass.
+    // Slots in [compactWrite, compactRead) are dead holes while it runs.
+    bool compacting = false;
+    size_t compactRead = 0, compactWrite = 0;
+    static constexpr double COMPACT_DEAD_RATIO = 0.25;
+    static constexpr size_t COMPACT_MIN_DEAD = 1024;
+    static constexpr size_t COMPACT_STEP = 256;              // slots visited per mutation
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+    static constexpr int ASYNC_SCAN_CHUNK = 4096;            // ids per resumption of an async scan
+
+    // Version history: each committed mutation saves a copy of ledgerState,
+    // which shares every node the mutation didn't touch. Rows live in an
+    // append-only archive, so old versions survive compaction. Trie nodes and
+    // the version list live in their own pool: the index pool is released
+    // wholesale by compact(), and history must outlive that.
+    CountingResource historyUpstream;
+    mutable pmr::unsynchronized_pool_resource historyPool{&historyUpstream};
+    mutable vector<Transaction> rowArchive = vector<Transaction>(1);   // index 0 unused
+    mutable VersionTrie ledgerState{&historyPool};           // id -> archive index | ROW_LIVE
+    mutable pmr::deque<VersionTrie> versions{&historyPool};  // committed versions, oldest first
+    mutable size_t firstVersion = 0;                         // version number of versions.front()
+    size_t historyLimit = SIZE_MAX;
+    static constexpr uint32_t ROW_LIVE = 1u << 31;
+
+    // Durability: mutations are logged here once openDurable() succeeds
+    unique_ptr<WriteAheadLog> wal;
+    string snapshotPath;
+    uint32_t walGeneration = 0;
+    vector<char> walScratch;                   // reused record buffer
+    vector<pair<int, int>> batchDates;         // ordered index entries of a batch add
+    vector<pair<double, int>> batchAmounts;
+
+    // Snapshot, segment and CSV file I/O share one backend, made on first
+    // use: a ring costs a setup syscall and its mappings. Saves may run on an
+    // executor's helper thread, so use of it is serialized.
+    mutable unique_ptr<IoBackend> fileIo;
+    mutable mutex fileIoLock;
+
+    // Equi-depth amount quantiles, rebuilt when the table drifts by 25%
+    static const int QUANTILE_BUCKETS = 16;
+    mutable vector<double> amountQuantiles;
+    mutable size_t quantileRows = 0;
+
+    // Relative cost of fetching a row through an index vs scanning it
+    static constexpr double INDEX_LOOKUP_COST = 4.0;
+    // Cost per id of combining bitmaps, which go a container word at a time
+    static constexpr double BITMAP_MERGE_COST = 1.0 / 16;
+
+    // Per-node bookkeeping in the standard containers, for memory estimates:
+    // red-black links and color, or a hash chain link plus cached hash
+    static constexpr size_t TREE_NODE_OVERHEAD = 4 * sizeof(void*);
+    static constexpr size_t HASH_NODE_OVERHEAD = 2 * sizeof(void*);
+
+    template <typename F>
+    auto withFileIo(F&& f) const {
+        lock_guard<mutex> lock(fileIoLock);
+        if (!fileIo) fileIo = makeIoBackend();
+        return f(*fileIo);
+    }
+
+    // Copies a row's strings into the arena so it no longer points at caller memory
+    Transaction adopt(Transaction t) {
+        t.category = strings.intern(t.category);
+        t.type = strings.intern(t.type);
+        t.description = strings.copy(t.description);
+        return t;
+    }
+
+    bool isLive(size_t slot) const {
+        return (liveBits[slot >> 6] >> (slot & 63)) & 1;
+    }
+
+    void setLiveBit(size_t slot, bool live) {
+        if (live) liveBits[slot >> 6] |= uint64_t(1) << (slot & 63);
+        else liveBits[slot >> 6] &= ~(uint64_t(1) << (slot & 63));
+    }
+
+    // Slot of a live transaction, NO_SLOT if unknown or tombstoned
+    uint32_t liveSlot(int id) const {
+        if (id <= 0 || (size_t)id >= slotOf.size()) return NO_SLOT;
+        uint32_t slot = slotOf[id];
+        return (slot != NO_SLOT && isLive(slot)) ? slot : NO_SLOT;
+    }
+
+    // Slot of a row, live or tombstoned, NO_SLOT once reclaimed
+    uint32_t anySlot(int id) const {
+        return (id > 0 && (size_t)id < slotOf.size()) ? slotOf[id] : NO_SLOT;
+    }
+
+    template <typename F>
+    void forEachLive(F f) const {
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            if (isLive(i)) f(transactions[i]);
+        }
+    }
+
+    void ensureIndexes() const {
+        if (indexesBuilt) return;
+        indexesBuilt = true;
+        vector<pair<int, int>> dates;
+        vector<pair<double, int>> amounts;
+        dates.reserve(transactions.size());
+        amounts.reserve(transactions.size());
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            indexInsertHashed(transactions[i], i);
+            dates.push_back({transactions[i].date.key(), transactions[i].id});
+            amounts.push_back({transactions[i].amount, transactions[i].id});
+        }
+        insertSorted(dateIndex, dates);
+        insertSorted(amountIndex, amounts);
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            if (!isLive(i)) continue;
+            monthHistogram[transactions[i].date.monthKey()]++;
+            bitmapInsert(transactions[i]);
+            viewApply(transactions[i], 1);
+            recordRow(transactions[i], true);
+        }
+        // Nothing commits before the indexes exist, so version 0 is still the
+        // loaded state; this fills in its rows without adding a version
+        versions.front() = ledgerState;
+    }
+
+    void indexInsert(const Transaction& t, size_t slot) const {
+        indexInsertHashed(t, slot);
+        dateIndex.insert({t.date.key(), t.id});
+        amountIndex.insert({t.amount, t.id});
+    }
+
+    // The slot map and category list only; the ordered indexes are left
+    // to the caller, which can insert a whole batch in key order
+    void indexInsertHashed(const Transaction& t, size_t slot) const {
+        if (slotOf.size() <= (size_t)t.id) slotOf.resize(t.id + 1, NO_SLOT);
+        slotOf[t.id] = slot;
+        // Category lists stay in id order; only a re-inserted row lands mid-list
+        auto& ids = categoryMap[t.category];
+        if (ids.empty() || ids.back() < t.id) ids.push_back(t.id);
+        else ids.insert(lower_bound(ids.begin(), ids.end(), t.id), t.id);
+    }
+
+    void bitmapInsert(const Transaction& t) const {
+        categoryBitmaps[t.category].add(t.id);
+        typeBitmaps[t.type].add(t.id);
+        monthBitmaps[t.date.monthKey()].add(t.id);
+    }
+
+    void bitmapErase(const Transaction& t) const {
+        bitmapErase(categoryBitmaps, t.category, t.id);
+        bitmapErase(typeBitmaps, t.type, t.id);
+        bitmapErase(monthBitmaps, t.date.monthKey(), t.id);
+    }
+
+    void viewApply(const Transaction& t, int sign) const {
+        for (auto& entry : views) entry.second.apply(t, sign);
+    }
+
+    template <typename Map, typename Key>
+    static void bitmapErase(Map& bitmaps, const Key& key, int id) {
+        auto it = bitmaps.find(key);
+        if (it != bitmaps.end() && it->second.remove(id) && it->second.empty()) bitmaps.erase(it);
+    }
+
+    // Inserts keys in sorted order, each hinted just past the previous one.
+    // Keys that land next to each other - a batch's rows on one date, since
+    // new ids are the largest - cost O(1) instead of a root-to-leaf search,
+    // and filling an empty index is O(n) after the sort.
+    template <typename Index, typename Key>
+    static void insertSorted(Index& index, vector<Key>& keys) {
+        sort(keys.begin(), keys.end());
+        auto hint = index.end();
+        for (const Key& k : keys) hint = next(index.emplace_hint(hint, k));
+    }
+
+    // Overwrites a row in place (same id), moving only the index entries and
+    // histogram counts whose key changed - O(log n), plus O(k) for a category move
+    void rewriteRow(size_t slot, const Transaction& t) {
+        Transaction& old = transactions[slot];
+        bool regroup = isLive(slot) && (old.category != t.category || old.type != t.type ||
+                                        old.date.monthKey() != t.date.monthKey());
+        if (regroup) bitmapErase(old);
+        if (isLive(slot)) viewApply(old, -1);
+        if (old.date.key() != t.date.key()) {
+            dateIndex.erase({old.date.key(), t.id});
+            dateIndex.insert({t.date.key(), t.id});
+            if (isLive(slot) && old.date.monthKey() != t.date.monthKey()) {
+                auto hit = monthHistogram.find(old.date.monthKey());
+                if (hit != monthHistogram.end() && --hit->second == 0) monthHistogram.erase(hit);
+                monthHistogram[t.date.monthKey()]++;
+            }
+        }
+        if (old.amount != t.amount) {
+            amountIndex.erase({old.amount, t.id});
+            amountIndex.insert({t.amount, t.id});
+        }
+        if (old.category != t.category) {
+            auto& from = categoryMap[old.category];
+            auto pos = lower_bound(from.begin(), from.end(), t.id);
+            if (pos != from.end() && *pos == t.id) from.erase(pos);
+            auto& to = categoryMap[t.category];
+            to.insert(lower_bound(to.begin(), to.end(), t.id), t.id);
+        }
+        old = t;
+        if (regroup) bitmapInsert(t);
+        if (isLive(slot)) viewApply(t, 1);
+    }
+
+    // Makes a row match archived version `entry` and returns the archive index
+    // of the version it replaced, so calling it again with that index reverts it
+    uint32_t swapRowVersion(uint32_t entry) {
+        Transaction t = rowArchive[entry];
+        uint32_t state = ledgerState.get(t.id);
+        uint32_t slot = anySlot(t.id);
+        if (slot != NO_SLOT) rewriteRow(slot, t);
+        ledgerState.set(t.id, entry | (state & ROW_LIVE));
+        return state & ~ROW_LIVE;
+    }
+
+    uint32_t archiveRow(const Transaction& t) const {
+        rowArchive.push_back(t);
+        return (uint32_t)rowArchive.size() - 1;
+    }
+
+    // Sets a row's liveness in the current version, archiving it on first sight
+    void recordRow(const Transaction& t, bool live) const {
+        uint32_t entry = ledgerState.get(t.id) & ~ROW_LIVE;
+        if (entry == 0) entry = archiveRow(t);
+        ledgerState.set(t.id, live ? entry | ROW_LIVE : entry);
+    }
+
+    // Saves the current state as the next version
+    void commitVersion() {
+        versions.push_back(ledgerState);
+        while (versions.size() > historyLimit) {
+            versions.pop_front();
+            ++firstVersion;
+        }
+    }
+
+    const VersionTrie* findVersion(size_t version) const {
+        ensureIndexes();
+        if (version < firstVersion || version - firstVersion >= versions.size()) return nullptr;
+        return &versions[version - firstVersion];
+    }
+
+    // ----- Liveness changes: O(log n), indexes are left in place -----
+    void markDead(size_t slot) {
+        setLiveBit(slot, false);
+        --liveCount;
+        auto hit = monthHistogram.find(transactions[slot].date.monthKey());
+        if (hit != monthHistogram.end() && --hit->second == 0) monthHistogram.erase(hit);
+        bitmapErase(transactions[slot]);
+        viewApply(transactions[slot], -1);
+        recordRow(transactions[slot], false);
+    }
+
+    void markLive(size_t slot) {
+        setLiveBit(slot, true);
+        ++liveCount;
+        monthHistogram[transactions[slot].date.monthKey()]++;
+        bitmapInsert(transactions[slot]);
+        viewApply(transactions[slot], 1);
+        recordRow(transactions[slot], true);
+    }
+
+    // Appends a new live row; ids only grow, so slots stay in id order.
+    // Without ordered, the caller adds the date and amount index entries.
+    void storeAppend(const Transaction& t, bool ordered = true) {
+        ensureIndexes();
+        transactions.push_back(t);
+        if (liveBits.size() * 64 < transactions.size()) liveBits.push_back(0);
+        if (ordered) indexInsert(t, transactions.size() - 1);
+        else indexInsertHashed(t, transactions.size() - 1);
+        markLive(transactions.size() - 1);
+    }
+
+    // Re-inserts reclaimed rows at their id positions in one merge pass -
+    // O(n + k log k). Only needed when log replay or a restore revives rows
+    // that compaction or an older checkpoint already dropped. Callers finish
+    // any compaction pass before deciding which rows are missing.
+    void storeInsertOrdered(vector<Transaction> rows) {
+        ensureIndexes();
+        sort(rows.begin(), rows.end(), [](const Transaction& a, const Transaction& b) { return a.id < b.id; });
+        vector<Transaction> merged;
+        merged.reserve(transactions.size() + rows.size());
+        vector<uint64_t> bits((transactions.size() + rows.size() + 63) / 64, 0);
+        vector<size_t> inserted;
+        size_t i = 0, j = 0;
+        while (i < transactions.size() || j < rows.size()) {
+            size_t pos = merged.size();
+            if (j == rows.size() || (i < transactions.size() && transactions[i].id < rows[j].id)) {
+                if (isLive(i)) bits[pos >> 6] |= uint64_t(1) << (pos & 63);
+                slotOf[transactions[i].id] = pos;
+                merged.push_back(transactions[i++]);
+            } else {
+                inserted.push_back(pos);
+                merged.push_back(rows[j++]);
+            }
+        }
+        transactions.swap(merged);
+        liveBits.swap(bits);
+        for (size_t pos : inserted) {
+            const Transaction& t = transactions[pos];
+            indexInsert(t, pos);
+            ledgerState.set(t.id, archiveRow(t));   // its contents may differ from the archived version
+            markLive(pos);
+        }
+    }
+
+    // ----- Compaction -----
+    void maybeCompact() {
+        // Pinned tombstones are never reclaimed, so they don't count as garbage
+        size_t dead = transactions.size() - liveCount - pinnedIds.size();
+        if (!compacting && dead >= COMPACT_MIN_DEAD && dead > transactions.size() * COMPACT_DEAD_RATIO) {
+            compacting = true;
+            compactRead = compactWrite = 0;
+        }
+        if (compacting) compactStep(COMPACT_STEP);
+    }
+
+    // Visits up to budget slots; pinned tombstones move along with live rows
+    void compactStep(size_t budget) {
+        while (budget-- > 0 && compactRead < transactions.size()) {
+            const Transaction& t = transactions[compactRead];
+            if (isLive(compactRead) || pinnedIds.count(t.id)) {
+                if (compactWrite != compactRead) {
+                    bool live = isLive(compactRead);
+                    transactions[compactWrite] = t;
+                    slotOf[t.id] = compactWrite;
+                    setLiveBit(compactWrite, live);
+                    setLiveBit(compactRead, false);
+                }
+                ++compactWrite;
+            } else {
+                dateIndex.erase({t.date.key(), t.id});
+                amountIndex.erase({t.amount, t.id});
+                slotOf[t.id] = NO_SLOT;
+            }
+            ++compactRead;
+        }
+        if (compactRead < transactions.size()) return;
+
+        // Pass complete: drop the hole tail and reclaimed category entries
+        transactions.resize(compactWrite);
+        liveBits.resize((compactWrite + 63) / 64);
+        for (auto& entry : categoryMap) {
+            auto& ids = entry.second;
+            ids.erase(remove_if(ids.begin(), ids.end(),
+                                [this](int id) { return slotOf[id] == NO_SLOT; }), ids.end());
+        }
+        compacting = false;
+    }
+
+    void finishCompaction() {
+        while (compacting) compactStep(SIZE_MAX);
+    }
+
+    // Rebuilds every pool-backed index so the pool can hand its freed
+    // nodes back. Expects a finished compaction, so every slot is indexed.
+    void rebuildIndexPool() {
+        vector<pair<string_view, vector<int>>> lists;
+        lists.reserve(categoryMap.size());
+        for (const auto& entry : categoryMap) {
+            lists.emplace_back(entry.first, vector<int>(entry.second.begin(), entry.second.end()));
+        }
+        vector<int> pinned(pinnedIds.begin(), pinnedIds.end());
+        vector<pair<int, size_t>> months(monthHistogram.begin(), monthHistogram.end());
+
+        categoryMap = decltype(categoryMap)(&indexPool);
+        pinnedIds = decltype(pinnedIds)(&indexPool);
+        dateIndex = decltype(dateIndex)(&indexPool);
+        amountIndex = decltype(amountIndex)(&indexPool);
+        monthHistogram = decltype(monthHistogram)(&indexPool);
+        indexPool.release();
+
+        categoryMap.reserve(lists.size());
+        for (auto& entry : lists) {
+            categoryMap[entry.first].assign(entry.second.begin(), entry.second.end());
+        }
+        pinnedIds.insert(pinned.begin(), pinned.end());
+        monthHistogram.insert(months.begin(), months.end());
+        vector<pair<int, int>> dates;
+        vector<pair<double, int>> amounts;
+        dates.reserve(transactions.size());
+        amounts.reserve(transactions.size());
+        for (const Transaction& t : transactions) {
+            dates.push_back({t.date.key(), t.id});
+            amounts.push_back({t.amount, t.id});
+        }
+        insertSorted(dateIndex, dates);
+        insertSorted(amountIndex, amounts);
+    }
+
+    // ----- Selectivity estimates -----
+    double estimateDateRows(const Date& start, const Date& end) const {
+        if (end.key() < start.key()) return 0;
+        double rows = 0;
+        auto it = monthHistogram.lower_bound(start.monthKey());
+        for (; it != monthHistogram.end() && it->first <= end.monthKey(); ++it) {
+            // Assume rows are spread evenly over the days of a month
+            int firstDay = (it->first == start.monthKey()) ? start.day : 1;
+            int lastDay = (it->first == end.monthKey()) ? end.day : 31;
+            double fraction = max(0, lastDay - firstDay + 1) / 31.0;
+            rows += it->second * fraction;
+        }
+        return rows;
+    }
+
+    void refreshAmountQuantiles() const {
+        size_t n = amountIndex.size();
+        if (!amountQuantiles.empty() && n * 4 <= quantileRows * 5 && n * 5 >= quantileRows * 4) return;
+        amountQuantiles.clear();
+        quantileRows = n;
+        if (n == 0) return;
+        size_t step = max<size_t>(1, n / QUANTILE_BUCKETS), i = 0;
+        for (const auto& entry : amountIndex) {
+            if (i % step == 0) amountQuantiles.push_back(entry.first);
+            ++i;
+        }
+        amountQuantiles.push_back(amountIndex.rbegin()->first);
+    }
+
+    double estimateAmountRows(double lo, double hi) const {
+        refreshAmountQuantiles();
+        if (amountQuantiles.size() < 2 || hi < lo) return 0;
+        // Each gap between boundaries holds ~n/buckets rows; interpolate partial gaps
+        double perBucket = (double)quantileRows / (amountQuantiles.size() - 1);
+        double rows = 0;
+        for (size_t b = 0; b + 1 < amountQuantiles.size(); ++b) {
+            double bLo = amountQuantiles[b], bHi = amountQuantiles[b + 1];
+            double oLo = max(lo, bLo), oHi = min(hi, bHi);
+            if (oHi < oLo) continue;
+            rows += (bHi > bLo) ? perBucket * (oHi - oLo) / (bHi - bLo) : perBucket;
+        }
+        return min(rows, (double)quantileRows);
+    }
+
+    // ----- Planner: cheapest access path for a query -----
+    QueryPlan planQuery(const Query& q) const {
+        ensureIndexes();
+        QueryPlan plan;
+        plan.path = FULL_SCAN;
+        plan.estimatedRows = transactions.size();
+        plan.estimatedCost = transactions.size();
+
+        auto consider = [&plan](AccessPath path, double rows, double cost) {
+            if (cost < plan.estimatedCost) {
+                plan.path = path;
+                plan.estimatedRows = rows;
+                plan.estimatedCost = cost;
+            }
+        };
+        if (!q.category.empty()) {
+            auto it = categoryMap.find(q.category);
+            double rows = (it == categoryMap.end()) ? 0 : it->second.size();
+            consider(CATEGORY_LIST, rows, rows);    // rows are stored inline
+        }
+        if (q.hasDateRange) {
+            double rows = estimateDateRows(q.start, q.end);
+            consider(DATE_INDEX, rows, rows * INDEX_LOOKUP_COST);
+        }
+        if (q.hasAmountRange) {
+            double rows = estimateAmountRows(q.minAmount, q.maxAmount);
+            consider(AMOUNT_INDEX, rows, rows * INDEX_LOOKUP_COST);
+        }
+        if (liveCount > 0 && (!q.category.empty() || !q.type.empty() || q.hasDateRange)) {
+            // Predicates assumed independent; the date range selects whole months
+            double rows = liveCount, merged = 0;
+            auto select = [&](size_t ids) {
+                rows *= (double)ids / liveCount;
+                merged += ids;
+            };
+            if (!q.category.empty()) select(bitmapRows(categoryBitmaps, q.category));
+            if (!q.type.empty()) select(bitmapRows(typeBitmaps, q.type));
+            if (q.hasDateRange) {
+                size_t ids = 0;
+                auto it = monthHistogram.lower_bound(q.start.monthKey());
+                for (; it != monthHistogram.end() && it->first <= q.end.monthKey(); ++it) ids += it->second;
+                select(ids);
+            }
+            consider(BITMAP_INDEX, rows, rows + merged * BITMAP_MERGE_COST);
+        }
+        return plan;
+    }
+
+    template <typename Map>
+    static size_t bitmapRows(const Map& bitmaps, string_view key) {
+        auto it = bitmaps.find(key);
+        return it == bitmaps.end() ? 0 : it->second.cardinality();
+    }
+
+    // ORs the bitmaps of each list and ANDs the lists, smallest first.
+    // Sets constrained to false, and returns nothing, when every list is empty.
+    RoaringBitmap matchBitmaps(const BitmapQuery& b, bool& constrained) const {
+        vector<RoaringBitmap> sets;
+        auto anyOf = [&sets](const auto& bitmaps, const auto& keys) {
+            if (keys.empty()) return;
+            RoaringBitmap ids;
+            for (const auto& key : keys) {
+                auto it = bitmaps.find(key);
+                if (it != bitmaps.end()) ids = ids | it->second;
+            }
+            sets.push_back(move(ids));
+        };
+        anyOf(categoryBitmaps, b.categories);
+        anyOf(typeBitmaps, b.types);
+        anyOf(monthBitmaps, b.months);
+        constrained = !sets.empty();
+        if (sets.empty()) return RoaringBitmap();
+        sort(sets.begin(), sets.end(),
+             [](const RoaringBitmap& a, const RoaringBitmap& b) { return a.cardinality() < b.cardinality(); });
+        RoaringBitmap ids = move(sets[0]);
+        for (size_t i = 1; i < sets.size() && !ids.empty(); ++i) ids = ids & sets[i];
+        return ids;
+    }
+
+    // Runs the plan, returning matches in storage order
+    vector<Transaction> runQuery(const Query& q, QueryPlan& plan) const {
+        vector<Transaction> result;
+        vector<size_t> positions;
+        auto probe = [&](int id) {
+            ++plan.rowsTouched;
+            uint32_t pos = liveSlot(id);
+            if (pos != NO_SLOT && q.matches(transactions[pos])) positions.push_back(pos);
+        };
+
+        switch (plan.path) {
+        case FULL_SCAN:
+            for (size_t i = 0; i < transactions.size(); ++i) {
+                ++plan.rowsTouched;
+                if (isLive(i) && q.matches(transactions[i])) result.push_back(transactions[i]);
+            }
+            break;
+        case CATEGORY_LIST: {
+            auto it = categoryMap.find(q.category);
+            if (it == categoryMap.end()) break;
+            for (int id : it->second) probe(id);
+            break;
+        }
+        case DATE_INDEX: {
+            if (q.end.key() < q.start.key()) break;     // empty range; the walk below would run past it
+            auto first = dateIndex.lower_bound({q.start.key(), INT_MIN});
+            auto last = dateIndex.upper_bound({q.end.key(), INT_MAX});
+            for (auto it = first; it != last; ++it) probe(it->second);
+            break;
+        }
+        case AMOUNT_INDEX: {
+            if (q.maxAmount < q.minAmount) break;
+            auto first = amountIndex.lower_bound({q.minAmount, INT_MIN});
+            auto last = amountIndex.upper_bound({q.maxAmount, INT_MAX});
+            for (auto it = first; it != last; ++it) probe(it->second);
+            break;
+        }
+        case BITMAP_INDEX: {
+            BitmapQuery b;
+            if (!q.category.empty()) b.categories.push_back(q.category);
+            if (!q.type.empty()) b.types.push_back(q.type);
+            if (q.hasDateRange) {
+                auto it = monthBitmaps.lower_bound(q.start.monthKey());
+                for (; it != monthBitmaps.end() && it->first <= q.end.monthKey(); ++it) b.months.push_back(it->first);
+                if (b.months.empty()) break;      // no live row in range
+            }
+            bool constrained;
+            RoaringBitmap ids = matchBitmaps(b, constrained);
+            ids.forEach([&probe](uint32_t id) { probe((int)id); });
+            break;
+        }
+        }
+
+        if (plan.path != FULL_SCAN) {
+            sort(positions.begin(), positions.end());
+            for (size_t pos : positions) result.push_back(transactions[pos]);
+        }
+        plan.rowsReturned = result.size();
+        EXPENSE_METRIC_ROWS(plan.rowsTouched, plan.rowsReturned);
+        EXPENSE_METRIC_PATH(plan.path, plan.rowsTouched, plan.rowsReturned);
+        return result;
+    }
+
+    // Walks the id or date index from the cursor and stops after limit + 1 matches
+    Page collectPage(const Query& q, const PageRequest& req) const {
+        EXPENSE_METRIC_SCOPE(METRIC_QUERY_PAGE);
+        ensureIndexes();
+        Page page;
+        page.next = req;
+        size_t skip = req.hasCursor ? 0 : req.offset;
+        size_t scanned = 0;
+        auto take = [&](size_t pos) {
+            ++scanned;
+            const Transaction& t = transactions[pos];
+            if (!isLive(pos) || !q.matches(t)) return true;
+            if (skip > 0) { --skip; return true; }
+            if (page.rows.size() == req.limit) { page.hasMore = true; return false; }
+            page.rows.push_back(t);
+            return true;
+        };
+
+        if (req.order == BY_DATE) {
+            pair<int, int> from = {q.hasDateRange ? q.start.key() : INT_MIN, INT_MIN};
+            int lastKey = q.hasDateRange ? q.end.key() : INT_MAX;
+            auto it = dateIndex.lower_bound(from);
+            if (req.hasCursor && make_pair(req.afterDate, req.afterId) >= from) {
+                it = dateIndex.upper_bound({req.afterDate, req.afterId});
+            }
+            for (; it != dateIndex.end() && it->first <= lastKey; ++it) {
+                if (!take(slotOf[it->second])) break;
+            }
+        } else {
+            // Slots are in id order, so resume at the first remaining id after the cursor
+            size_t slot = 0;
+            if (req.hasCursor) {
+                slot = transactions.size();
+                for (size_t id = req.afterId + 1; id < slotOf.size(); ++id) {
+                    if (slotOf[id] != NO_SLOT) { slot = slotOf[id]; break; }
+                }
+            }
+            for (; slot < transactions.size(); ++slot) {
+                if (!take(slot)) break;
+            }
+        }
+
+        if (!page.rows.empty()) {
+            page.next.hasCursor = true;
+            page.next.offset = 0;
+            page.next.afterId = page.rows.back().id;
+            page.next.afterDate = page.rows.back().date.key();
+        }
+        EXPENSE_METRIC_ROWS(scanned, page.rows.size());
+        return page;
+    }
+
+    // Copies the live rows into snapshot columns, strings dictionary-encoded
+    SnapshotImage snapshotImage() const {
+        SnapshotImage image;
+        SnapshotHeader& h = image.header;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+        h.version = SNAPSHOT_VERSION;
+        h.rowCount = liveCount;
+        h.nextId = nextId;
+        h.walGeneration = walGeneration;
+
+        unordered_map<string_view, uint32_t> codes;
+        vector<string_view> dict;
+        auto encode = [&](string_view str) {
+            auto it = codes.find(str);
+            if (it != codes.end()) return it->second;
+            uint32_t code = dict.size();
+            codes.emplace(str, code);
+            dict.push_back(str);
+            return code;
+        };
+        size_t n = liveCount, i = 0;
+        image.ids.resize(n);
+        image.dates.resize(n);
+        image.amounts.resize(n);
+        image.cats.resize(n);
+        image.types.resize(n);
+        image.descs.resize(n);
+        forEachLive([&](const Transaction& t) {
+            image.ids[i] = t.id;
+            image.dates[i] = t.date.key();
+            image.amounts[i] = t.amount;
+            image.cats[i] = encode(t.category);
+            image.types[i] = encode(t.type);
+            image.descs[i] = encode(t.description);
+            ++i;
+        });
+        h.dictCount = dict.size();
+
+        image.dictBytes = packDictionary(dict);
+        return image;
+    }
+
+    // Logs a mutation before it is applied. False when the log could not
+    // be written; the caller then leaves the ledger untouched.
+    bool logMutation(WalRecordType type, const vector<char>& payload) {
+        if (!wal || wal->append(type, payload)) return true;
+        cout << "✗ Cannot write write-ahead log: " << wal->filePath()
+             << " (the change was not applied; changes are refused until a checkpoint succeeds)\n";
+        return false;
+    }
+
+    // Checkpoints once the log grows past the threshold, after a logged
+    // mutation has been applied. Never inside an open group, so a group is
+    // never split between a snapshot and the log.
+    void maybeCheckpoint() {
+        if (!wal) return;
+        size_t every = wal->options().checkpointEvery;
+        if (every > 0 && groupDepth == 0 && wal->recordsSinceTruncate() >= every) checkpoint();
+    }
+
+    // A failed log has lost records, so nothing more is changed until a
+    // checkpoint has saved the whole ledger and started a fresh log
+    bool logWritable() const {
+        if (!wal || wal->healthy()) return true;
+        cout << "✗ Write-ahead log is failing; changes are refused until a checkpoint succeeds.\n";
+        return false;
+    }
+
+    // Tombstones a row and pins it so the compactor keeps it for undo
+    void tombstone(size_t slot) {
+        int id = transactions[slot].id;
+        markDead(slot);
+        pinnedIds.insert(id);
+        undoStack.push({DELETE_OP, id});
+    }
+
+    // ----- Undo units and redo -----
+    // A new mutation invalidates everything undone so far. Rows whose ADD
+    // was undone were only pinned for redo, so they become garbage.
+    void clearRedo() {
+        for (const UndoOp& op : redoStack) {
+            if (op.op == ADD) pinnedIds.erase(op.id);
+        }
+        redoStack.clear();
+    }
+
+    void openGroup() {
+        if (groupDepth++ == 0) undoStack.push({GROUP_BEGIN, 0});
+    }
+
+    void closeGroup() {
+        if (groupDepth == 0 || --groupDepth > 0) return;
+        UndoOp last;
+        if (undoStack.top(last) && last.op == GROUP_BEGIN) undoStack.pop(last);   // empty group
+        else undoStack.push({GROUP_END, 0});
+    }
+
+    // Pops the newest unit into ops, newest op first. A group whose
+    // GROUP_BEGIN was shed by the memory budget ends where the journal does.
+    void popUndoUnit(vector<UndoOp>& ops) {
+        ops.clear();
+        UndoOp top;
+        while (ops.empty() && undoStack.pop(top)) {
+            if (top.op != GROUP_END) {
+                if (top.op != GROUP_BEGIN) ops.push_back(top);
+                continue;
+            }
+            UndoOp op;
+            while (undoStack.pop(op) && op.op != GROUP_BEGIN) ops.push_back(op);
+        }
+    }
+
+    // Journal order is oldest op first, so redo order is stored mirrored:
+    // GROUP_END at the bottom and GROUP_BEGIN on top
+    void pushRedoUnit(const vector<UndoOp>& ops) {
+        if (ops.size() == 1) { redoStack.push_back(ops[0]); return; }
+        redoStack.push_back({GROUP_END, 0});
+        redoStack.insert(redoStack.end(), ops.begin(), ops.end());
+        redoStack.push_back({GROUP_BEGIN, 0});
+    }
+
+    // Pops the newest undone unit into ops, oldest op first
+    void popRedoUnit(vector<UndoOp>& ops) {
+        ops.clear();
+        UndoOp top = redoStack.back();
+        redoStack.pop_back();
+        if (top.op != GROUP_BEGIN) { ops.push_back(top); return; }
+        while (!redoStack.empty()) {
+            UndoOp op = redoStack.back();
+            redoStack.pop_back();
+            if (op.op == GROUP_END) break;
+            ops.push_back(op);
+        }
+    }
+
+    void pushUndoUnit(const vector<UndoOp>& ops) {
+        if (ops.size() > 1) undoStack.push({GROUP_BEGIN, 0});
+        for (const UndoOp& op : ops) undoStack.push(op);
+        if (ops.size() > 1) undoStack.push({GROUP_END, 0});
+    }
+
+    // Applies a whole unit as one batch: every op is a liveness flip, so the
+    // indexes are untouched and compaction runs once afterwards. Undo revives
+    // deleted rows and kills added ones; redo does the opposite. Killed rows
+    // are pinned because the other stack can still bring them back. An UPDATE
+    // swaps row versions either way and is left pointing at the one it replaced.
+    void applyUnit(vector<UndoOp>& ops, bool undoing) {
+        for (UndoOp& op : ops) {
+            if (op.op == UPDATE) {
+                op.id = (int)swapRowVersion(op.id);
+            } else if ((op.op == DELETE_OP) == undoing) {
+                uint32_t slot = anySlot(op.id);
+                if (slot != NO_SLOT && !isLive(slot)) markLive(slot);
+                pinnedIds.erase(op.id);
+            } else {
+                uint32_t slot = liveSlot(op.id);
+                if (slot == NO_SLOT) continue;
+                markDead(slot);
+                pinnedIds.insert(op.id);
+            }
+        }
+    }
+
+    // Logs the rows themselves, so replay can apply a unit whose journal
+    // entries predate the last checkpoint. Runs before the unit is applied:
+    // each op carries its row as it will be afterwards, which is the version
+    // the unit's last UPDATE of that id installs, or else the current one.
+    bool logUnit(WalRecordType type, const vector<UndoOp>& ops) {
+        if (!wal) return true;
+        unordered_map<int, uint32_t> installed;   // id -> archive index
+        for (const UndoOp& op : ops) {
+            if (op.op == UPDATE) installed[rowArchive[op.id].id] = (uint32_t)op.id;
+        }
+        walScratch.clear();
+        walPut<uint32_t>(walScratch, (uint32_t)ops.size());
+        for (const UndoOp& op : ops) {
+            int id = (op.op == UPDATE) ? rowArchive[op.id].id : op.id;
+            auto it = installed.find(id);
+            uint32_t entry = it != installed.end() ? it->second : ledgerState.get(id) & ~ROW_LIVE;
+            walPut<uint8_t>(walScratch, (uint8_t)op.op);
+            walPutRow(walScratch, rowArchive[entry]);
+        }
+        return logMutation(type, walScratch);
+    }
+
+    // Re-applies one logged mutation without printing or re-logging
+    void replayRecord(WalRecordType type, const char* p) {
+        switch (type) {
+        case WAL_ADD: {
+            Transaction t = adopt(walGetRow(p));
+            clearRedo();
+            storeAppend(t);
+            undoStack.push({ADD, t.id});
+            nextId = max(nextId, t.id + 1);
+            break;
+        }
+        case WAL_DELETE: {
+            clearRedo();
+            uint32_t slot = liveSlot(walGet<int32_t>(p));
+            if (slot != NO_SLOT) tombstone(slot);
+            break;
+        }
+        case WAL_UPDATE: {
+            Transaction t = adopt(walGetRow(p));
+            clearRedo();
+            if (liveSlot(t.id) != NO_SLOT) undoStack.push({UPDATE, (int)swapRowVersion(archiveRow(t))});
+            break;
+        }
+        case WAL_UNDO:
+        case WAL_REDO:
+        case WAL_RESTORE: {
+            // The logged unit is authoritative; the stacks are kept in step
+            // by popping whatever unit they hold on top
+            bool undoing = (type == WAL_UNDO);
+            if (type == WAL_RESTORE) clearRedo();
+            finishCompaction();
+            uint32_t n = walGet<uint32_t>(p);
+            vector<UndoOp> ops;
+            vector<Transaction> missing;
+            for (uint32_t i = 0; i < n; ++i) {
+                OpType op = (OpType)walGet<uint8_t>(p);
+                Transaction row = walGetRow(p);
+                if (op == UPDATE) {
+                    ops.push_back({op, (int)archiveRow(adopt(row))});
+                    continue;
+                }
+                bool revive = (op == DELETE_OP) == undoing;
+                if (revive && anySlot(row.id) == NO_SLOT) {
+                    missing.push_back(adopt(row));
+                    nextId = max(nextId, row.id + 1);
+                }
+                ops.push_back({op, row.id});
+            }
+            if (!missing.empty()) storeInsertOrdered(move(missing));
+            applyUnit(ops, undoing);
+            if (undoing) {
+                popUndoUnit(unitScratch);
+                pushRedoUnit(ops);
+            } else {
+                if (type == WAL_REDO && !redoStack.empty()) popRedoUnit(unitScratch);
+                pushUndoUnit(ops);
+            }
+            break;
+        }
+        case WAL_GROUP_BEGIN:
+            openGroup();
+            return;
+        case WAL_GROUP_END:
+            closeGroup();
+            return;
+        }
+        maybeCompact();
+        commitVersion();
+    }
+
+    static const char* pathName(AccessPath path) {
+        switch (path) {
+        case CATEGORY_LIST: return "CATEGORY LIST";
+        case DATE_INDEX:    return "DATE INDEX";
+        case AMOUNT_INDEX:  return "AMOUNT INDEX";
+        case BITMAP_INDEX:  return "BITMAP INDEX";
+        default:            return "FULL SCAN";
+        }
+    }
 
 public:
-    ExpenseManager() : nextId(1) {}
+    ExpenseManager() : nextId(1) {
+        undoStack.setDiscardHandler([this](const UndoOp& op) {
+            if (op.op == DELETE_OP) pinnedIds.erase(op.id);
+        });
+        versions.push_back(ledgerState);
+    }
 
     // ===== 1. ADD TRANSACTION =====
     // Time Complexity: O(1) - Array append + Hash map insert
-    void addTransaction(const Date& date, const string& category, double amount, 
-                       const string& desc, const string& type) {
-        Transaction t = {nextId++, date, category, amount, desc, type};
-        transactions.push_back(t);
-        categoryMap[category].push_back(t);
-        undoStack.push({ADD, t});
+    // Returns the new transaction's id, or 0 when the amount is invalid or
+    // the row could not be logged (it is then not added).
+    int addTransaction(const Date& date, string_view category, double amount, 
+                       string_view desc, string_view type) {
+        EXPENSE_METRIC_SCOPE(METRIC_ADD);
+        if (!validAmount(amount)) {
+            cout << "✗ Invalid amount.\n";
+            return 0;
+        }
+        if (!logWritable()) return 0;
+        Transaction t{nextId, date, category, amount, desc, type};
+        if (wal) {
+            walScratch.clear();
+            walPutRow(walScratch, t);
+            if (!logMutation(WAL_ADD, walScratch)) return 0;
+        }
+        ++nextId;
+        t = adopt(t);
+        clearRedo();
+        storeAppend(t);
+        undoStack.push({ADD, t.id});
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
         cout << "✓ Transaction added (ID: " << t.id << ")\n";
+        return t.id;
+    }
+
+    // ===== 1b. BATCH ADD =====
+    // Time Complexity: O(k) amortized - at most one reserve and a single summary line
+    // Each row's id is assigned here; the incoming id is ignored. Returns
+    // the first id, the rest follow consecutively. Returns 0, with nothing
+    // added, for an empty batch, an invalid amount or a log failure: every
+    // row is logged before the first one is applied.
+    int addTransactions(const vector<Transaction>& batch) {
+        EXPENSE_METRIC_SCOPE(METRIC_BATCH_ADD);
+        if (batch.empty()) return 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!validAmount(batch[i].amount)) {
+                cout << "✗ Invalid amount in row " << i + 1 << " of the batch; nothing was added.\n";
+                return 0;
+            }
+        }
+        if (!logWritable()) return 0;
+        int firstId = nextId;
+        if (wal) {
+            for (size_t i = 0; i < batch.size(); ++i) {
+                Transaction t = batch[i];
+                t.id = firstId + (int)i;
+                walScratch.clear();
+                walPutRow(walScratch, t);
+                if (!logMutation(WAL_ADD, walScratch)) return 0;
+            }
+        }
+        ensureIndexes();
+        // Grow geometrically: an exact reserve per batch would copy the
+        // whole array on every call of a stream of small batches
+        size_t needed = transactions.size() + batch.size();
+        if (needed > transactions.capacity()) transactions.reserve(max(needed, 2 * transactions.capacity()));
+        clearRedo();
+        batchDates.clear();
+        batchAmounts.clear();
+        for (const Transaction& row : batch) {
+            Transaction t = adopt(row);
+            t.id = nextId++;
+            storeAppend(t, false);
+            batchDates.push_back({t.date.key(), t.id});
+            batchAmounts.push_back({t.amount, t.id});
+            undoStack.push({ADD, t.id});
+            maybeCompact();
+        }
+        insertSorted(dateIndex, batchDates);
+        insertSorted(amountIndex, batchAmounts);
+        commitVersion();
+        maybeCheckpoint();
+        cout << "✓ " << batch.size() << " transactions added (IDs " << firstId
+             << "-" << (nextId - 1) << ")\n";
+        return firstId;
     }
 
     // ===== 2. DELETE TRANSACTION =====
-    // Time Complexity: O(n) - Linear search + removal
+    // Time Complexity: O(1) - tombstone; space is reclaimed by the compactor
     bool deleteTransaction(int id) {
-        for (size_t i = 0; i < transactions.size(); ++i) {
-            if (transactions[i].id == id) {
-                UndoOp uop = {DELETE_OP, transactions[i]};
-                string category = transactions[i].category;
-                
-                // Remove from categoryMap using lambda
-                auto& catTransactions = categoryMap[category];
-                catTransactions.erase(
-                    remove_if(catTransactions.begin(), catTransactions.end(),
-                             [id](const Transaction& t) { return t.id == id; }),
-                    catTransactions.end()
-                );
-                
-                // Remove from main transactions list
-                transactions.erase(transactions.begin() + i);
-                undoStack.push(uop);
-                
-                cout << "✓ Transaction (ID: " << id << ") deleted.\n";
-                return true;
-            }
+        EXPENSE_METRIC_SCOPE(METRIC_DELETE);
+        if (!logWritable()) return false;
+        ensureIndexes();
+        uint32_t slot = liveSlot(id);
+        if (slot == NO_SLOT) {
+            cout << "✗ Transaction ID not found.\n";
+            return false;
         }
-        cout << "✗ Transaction ID not found.\n";
-        return false;
+        if (wal) {
+            walScratch.clear();
+            walPut<int32_t>(walScratch, id);
+            if (!logMutation(WAL_DELETE, walScratch)) return false;
+        }
+        clearRedo();
+        tombstone(slot);
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
+
+        cout << "✓ Transaction (ID: " << id << ") deleted.\n";
+        return true;
+    }
+
+    // ===== 2b. UPDATE TRANSACTION =====
+    // Time Complexity: O(log n) - only the indexes whose key changed are
+    // touched; a category change also moves the id between two O(k) lists
+    // The id stays the same and a single UPDATE entry goes on the undo stack.
+    bool updateTransaction(int id, const TransactionUpdate& fields) {
+        EXPENSE_METRIC_SCOPE(METRIC_UPDATE);
+        if (!logWritable()) return false;
+        ensureIndexes();
+        uint32_t slot = liveSlot(id);
+        if (slot == NO_SLOT) {
+            cout << "✗ Transaction ID not found.\n";
+            return false;
+        }
+        if (fields.hasDate && !fields.date.isValid()) {
+            cout << "✗ Invalid date.\n";
+            return false;
+        }
+        if (fields.hasAmount && !validAmount(fields.amount)) {
+            cout << "✗ Invalid amount.\n";
+            return false;
+        }
+
+        const Transaction& old = transactions[slot];
+        Transaction t = old;
+        if (fields.hasDate) t.date = fields.date;
+        if (fields.hasAmount) t.amount = fields.amount;
+        if (!fields.category.empty() && fields.category != old.category) t.category = strings.intern(fields.category);
+        if (!fields.type.empty() && fields.type != old.type) t.type = strings.intern(fields.type);
+        if (fields.hasDescription && fields.description != old.description) t.description = strings.copy(fields.description);
+        if (t.date.key() == old.date.key() && t.amount == old.amount && t.category == old.category &&
+            t.type == old.type && t.description == old.description) {
+            cout << "✓ Transaction (ID: " << id << ") already up to date.\n";
+            return true;
+        }
+
+        if (wal) {
+            walScratch.clear();
+            walPutRow(walScratch, t);
+            if (!logMutation(WAL_UPDATE, walScratch)) return false;
+        }
+        clearRedo();
+        undoStack.push({UPDATE, (int)swapRowVersion(archiveRow(t))});
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
+
+        cout << "✓ Transaction (ID: " << id << ") updated.\n";
+        return true;
     }
 
     // ===== 3. UNDO LAST OPERATION =====
-    // Time Complexity: O(1) for stack pop + O(n) for removal
-    void undo() {
+    // Time Complexity: O(k) for a unit of k ops - each sets or clears a tombstone
+    // (a pop may first read one spilled chunk back from disk)
+    bool undo() {
+        EXPENSE_METRIC_SCOPE(METRIC_UNDO);
         if (undoStack.empty()) {
             cout << "✗ No operation to undo.\n";
-            return;
+            return false;
         }
-        
-        UndoOp uop = undoStack.top();
-        undoStack.pop();
-        
-        if (uop.op == ADD) {
-            // Undo add by removing
-            transactions.erase(
-                remove_if(transactions.begin(), transactions.end(),
-                         [uop](const Transaction& t) { return t.id == uop.data.id; }),
-                transactions.end()
-            );
-            
-            auto& catTransactions = categoryMap[uop.data.category];
-            catTransactions.erase(
-                remove_if(catTransactions.begin(), catTransactions.end(),
-                         [uop](const Transaction& t) { return t.id == uop.data.id; }),
-                catTransactions.end()
-            );
+        if (groupDepth > 0) {
+            cout << "✗ Cannot undo while a group is open.\n";
+            return false;
+        }
+        if (!logWritable()) return false;
+
+        ensureIndexes();
+        vector<UndoOp>& ops = unitScratch;
+        popUndoUnit(ops);
+        if (ops.empty()) {
+            cout << "✗ No operation to undo.\n";
+            return false;
+        }
+        if (!logUnit(WAL_UNDO, ops)) {
+            // Back on the journal as it was: pushUndoUnit takes oldest first
+            reverse(ops.begin(), ops.end());
+            pushUndoUnit(ops);
+            return false;
+        }
+        applyUnit(ops, true);
+        pushRedoUnit(ops);
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
+
+        if (ops.size() > 1) {
+            cout << "✓ Undo performed: " << ops.size() << " grouped operations reverted.\n";
+        } else if (ops[0].op == UPDATE) {
+            cout << "✓ Undo performed: Transaction updated is now reverted.\n";
+        } else if (ops[0].op == ADD) {
             cout << "✓ Undo performed: Transaction added is now removed.\n";
-        } 
-        else if (uop.op == DELETE_OP) {
-            // Undo delete by re-adding
-            transactions.push_back(uop.data);
-            categoryMap[uop.data.category].push_back(uop.data);
+        } else {
             cout << "✓ Undo performed: Transaction deleted is now restored.\n";
         }
+        return true;
+    }
+
+    // ===== 3b. REDO LAST UNDO =====
+    // Time Complexity: O(k) for a unit of k ops
+    // Any new add or delete clears the redo stack.
+    bool redo() {
+        EXPENSE_METRIC_SCOPE(METRIC_REDO);
+        if (redoStack.empty()) {
+            cout << "✗ No operation to redo.\n";
+            return false;
+        }
+        if (groupDepth > 0) {
+            cout << "✗ Cannot redo while a group is open.\n";
+            return false;
+        }
+        if (!logWritable()) return false;
+
+        ensureIndexes();
+        vector<UndoOp>& ops = unitScratch;
+        popRedoUnit(ops);
+        if (!logUnit(WAL_REDO, ops)) {
+            // Back on the redo stack as it was: pushRedoUnit takes newest first
+            reverse(ops.begin(), ops.end());
+            pushRedoUnit(ops);
+            return false;
+        }
+        applyUnit(ops, false);
+        pushUndoUnit(ops);
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
+
+        if (ops.size() > 1) {
+            cout << "✓ Redo performed: " << ops.size() << " grouped operations reapplied.\n";
+        } else if (ops[0].op == UPDATE) {
+            cout << "✓ Redo performed: Transaction updated again.\n";
+        } else if (ops[0].op == ADD) {
+            cout << "✓ Redo performed: Transaction added again.\n";
+        } else {
+            cout << "✓ Redo performed: Transaction deleted again.\n";
+        }
+        return true;
+    }
+
+    // ===== 3c. UNDO GROUPS =====
+    // Time Complexity: O(1)
+    // Adds and deletes between beginGroup() and endGroup() are undone and
+    // redone as one unit. Groups nest; only the outermost pair counts.
+    void beginGroup() {
+        if (logMutation(WAL_GROUP_BEGIN, {})) openGroup();
+    }
+
+    void endGroup() {
+        if (groupDepth == 0) {
+            cout << "✗ No open undo group.\n";
+            return;
+        }
+        if (!logMutation(WAL_GROUP_END, {})) return;
+        closeGroup();
+        maybeCheckpoint();
     }
 
     // ===== 4. GET TRANSACTIONS BY CATEGORY =====
     // Time Complexity: O(1) hash lookup + O(k) iteration
     void showByCategory(const string& category) const {
-        if (categoryMap.find(category) == categoryMap.end() || categoryMap.at(category).empty()) {
+        EXPENSE_METRIC_SCOPE(METRIC_SHOW_CATEGORY);
+        ensureIndexes();
+        vector<uint32_t> slots;
+        auto it = categoryMap.find(category);
+        if (it != categoryMap.end()) {
+            for (int id : it->second) {
+                uint32_t slot = liveSlot(id);
+                if (slot != NO_SLOT) slots.push_back(slot);
+            }
+            EXPENSE_METRIC_ROWS(it->second.size(), slots.size());
+        }
+        if (slots.empty()) {
             cout << "✗ No transactions in category: " << category << "\n";
             return;
         }
@@ -148,19 +5424,21 @@ public:
         cout << string(40, '-') << "\n";
         
         cout << fixed << setprecision(2);
-        for (const auto& t : categoryMap.at(category)) {
-            cout << left << setw(5) << t.id 
-                 << setw(12) << (to_string(t.date.day) + "/" + to_string(t.date.month) + "/" + to_string(t.date.year))
-                 << setw(10) << "₹" + to_string(t.amount)
-                 << t.description << "\n";
+        ReportWriter w;
+        for (uint32_t slot : slots) {
+            const Transaction& t = transactions[slot];
+            w.integer(t.id, 5).date(t.date, 12).amount(t.amount, 10)
+             .text(t.description).newline();
         }
+        w.flush();
         cout << "\n";
     }
 
     // ===== 5. DISPLAY ALL TRANSACTIONS =====
     // Time Complexity: O(n)
     void showAll() const {
-        if (transactions.empty()) {
+        EXPENSE_METRIC_SCOPE(METRIC_SHOW_ALL);
+        if (liveCount == 0) {
             cout << "✗ No transactions.\n";
             return;
         }
@@ -174,34 +5452,39 @@ public:
         cout << string(72, '-') << "\n";
         
         cout << fixed << setprecision(2);
-        for (const auto& t : transactions) {
-            cout << left << setw(5) << t.id 
-                 << setw(12) << (to_string(t.date.day) + "/" + to_string(t.date.month) + "/" + to_string(t.date.year))
-                 << setw(15) << t.category 
-                 << setw(10) << "₹" + to_string(t.amount)
-                 << setw(20) << t.description 
-                 << t.type << "\n";
-        }
+        ReportWriter w;
+        forEachLive([&w](const Transaction& t) {
+            w.integer(t.id, 5).date(t.date, 12).text(t.category, 15)
+             .amount(t.amount, 10).text(t.description, 20).text(t.type).newline();
+        });
+        w.flush();
+        EXPENSE_METRIC_ROWS(transactions.size(), liveCount);
         cout << "\n";
     }
 
     // ===== 6. CALCULATE MONTHLY TOTAL =====
     // Time Complexity: O(n)
     double getMonthlyTotal(int month, int year, const string& type = "") const {
+        EXPENSE_METRIC_SCOPE(METRIC_MONTHLY_TOTAL);
         double total = 0;
-        for (const auto& t : transactions) {
+        size_t matched = 0;
+        forEachLive([&](const Transaction& t) {
             if (t.date.month == month && t.date.year == year) {
                 if (type.empty() || t.type == type) {
                     total += t.amount;
+                    ++matched;
                 }
             }
-        }
+        });
+        EXPENSE_METRIC_ROWS(transactions.size(), matched);
         return total;
     }
 
     // ===== 7. GET CATEGORY SUMMARY =====
     // Time Complexity: O(n)
     void showCategorySummary() const {
+        EXPENSE_METRIC_SCOPE(METRIC_CATEGORY_SUMMARY);
+        ensureIndexes();
         cout << "\n" << string(50, '=') << "\n";
         cout << "CATEGORY SUMMARY\n";
         cout << string(50, '=') << "\n";
@@ -211,20 +5494,22 @@ public:
         cout << fixed << setprecision(2);
         for (const auto& pair : categoryMap) {
             double total = 0;
-            for (const auto& t : pair.second) {
-                if (t.type == "Expense") {
-                    total += t.amount;
+            for (int id : pair.second) {
+                uint32_t slot = liveSlot(id);
+                if (slot != NO_SLOT && transactions[slot].type == "Expense") {
+                    total += transactions[slot].amount;
                 }
             }
             cout << left << setw(20) << pair.first << "₹" << total << "\n";
+            EXPENSE_METRIC_ROWS(pair.second.size(), 1);
         }
         cout << "\n";
     }
 
     // ===== 8. SEARCH BY DATE RANGE =====
-    // Time Complexity: O(n) linear search
-    // Could be optimized to O(log n) with binary search if sorted
+    // Time Complexity: O(log n + k) via the date index, O(n) when the planner scans
     void searchByDateRange(const Date& start, const Date& end) const {
+        EXPENSE_METRIC_SCOPE(METRIC_DATE_RANGE);
         cout << "\n" << string(60, '=') << "\n";
         cout << "TRANSACTIONS IN DATE RANGE\n";
         cout << string(60, '=') << "\n";
@@ -233,16 +5518,18 @@ public:
         cout << string(50, '-') << "\n";
         
         cout << fixed << setprecision(2);
+        Query q;
+        q.hasDateRange = true;
+        q.start = start;
+        q.end = end;
         bool found = false;
-        for (const auto& t : transactions) {
-            if (t.date >= start && t.date <= end) {
-                cout << left << setw(12) << (to_string(t.date.day) + "/" + to_string(t.date.month) + "/" + to_string(t.date.year))
-                     << setw(15) << t.category 
-                     << setw(10) << "₹" + to_string(t.amount)
-                     << t.description << "\n";
-                found = true;
-            }
+        ReportWriter w;
+        for (const auto& t : query(q)) {
+            w.date(t.date, 12).text(t.category, 15).amount(t.amount, 10)
+             .text(t.description).newline();
+            found = true;
         }
+        w.flush();
         if (!found) {
             cout << "No transactions found in this date range.\n";
         }
@@ -250,26 +5537,38 @@ public:
     }
 
     // ===== 9. GET TOP EXPENSES =====
-    // Time Complexity: O(n log n) for sorting
-    void showTopExpenses(int n = 5) const {
-        vector<Transaction> expenses;
-        for (const auto& t : transactions) {
-            if (t.type == "Expense") {
-                expenses.push_back(t);
+    // Time Complexity: O(n log k) - a k-entry min-heap, so only the
+    // winners are copied. Ties go to the lower id.
+    vector<Transaction> topExpenses(int n) const {
+        EXPENSE_METRIC_SCOPE(METRIC_TOP_EXPENSES);
+        vector<Transaction> top;
+        if (n <= 0) return top;
+        auto better = [](const Transaction& a, const Transaction& b) {
+            return a.amount != b.amount ? a.amount > b.amount : a.id < b.id;
+        };
+        forEachLive([&](const Transaction& t) {
+            if (t.type != "Expense") return;
+            if ((int)top.size() < n) {
+                top.push_back(t);
+                push_heap(top.begin(), top.end(), better);
+            } else if (better(t, top.front())) {
+                pop_heap(top.begin(), top.end(), better);
+                top.back() = t;
+                push_heap(top.begin(), top.end(), better);
             }
-        }
-        
+        });
+        sort_heap(top.begin(), top.end(), better);
+        EXPENSE_METRIC_ROWS(transactions.size(), top.size());
+        return top;
+    }
+
+    void showTopExpenses(int n = 5) const {
+        vector<Transaction> expenses = topExpenses(n);
         if (expenses.empty()) {
             cout << "✗ No expenses found.\n";
             return;
         }
         
-        // Sort by amount (descending) using Quick Sort - O(n log n)
-        sort(expenses.begin(), expenses.end(), 
-             [](const Transaction& a, const Transaction& b) {
-                 return a.amount > b.amount;
-             });
-        
         cout << "\n" << string(60, '=') << "\n";
         cout << "TOP " << min(n, (int)expenses.size()) << " EXPENSES\n";
         cout << string(60, '=') << "\n";
@@ -278,18 +5577,19 @@ public:
         cout << string(45, '-') << "\n";
         
         cout << fixed << setprecision(2);
+        ReportWriter w;
         for (int i = 0; i < min(n, (int)expenses.size()); ++i) {
-            cout << left << setw(5) << (i + 1)
-                 << setw(15) << expenses[i].category 
-                 << setw(10) << "₹" + to_string(expenses[i].amount)
-                 << expenses[i].description << "\n";
+            w.integer(i + 1, 5).text(expenses[i].category, 15)
+             .amount(expenses[i].amount, 10).text(expenses[i].description).newline();
         }
+        w.flush();
         cout << "\n";
     }
 
     // ===== 10. SEARCH BY AMOUNT RANGE =====
-    // Time Complexity: O(n)
+    // Time Complexity: O(log n + k) via the amount index, O(n) when the planner scans
     void searchByAmountRange(double minAmount, double maxAmount) const {
+        EXPENSE_METRIC_SCOPE(METRIC_AMOUNT_RANGE);
         cout << "\n" << string(60, '=') << "\n";
         cout << "TRANSACTIONS IN AMOUNT RANGE: ₹" << minAmount << " - ₹" << maxAmount << "\n";
         cout << string(60, '=') << "\n";
@@ -298,16 +5598,18 @@ public:
         cout << string(45, '-') << "\n";
         
         cout << fixed << setprecision(2);
+        Query q;
+        q.hasAmountRange = true;
+        q.minAmount = minAmount;
+        q.maxAmount = maxAmount;
         bool found = false;
-        for (const auto& t : transactions) {
-            if (t.amount >= minAmount && t.amount <= maxAmount) {
-                cout << left << setw(5) << t.id
-                     << setw(15) << t.category 
-                     << setw(10) << "₹" + to_string(t.amount)
-                     << t.description << "\n";
-                found = true;
-            }
+        ReportWriter w;
+        for (const auto& t : query(q)) {
+            w.integer(t.id, 5).text(t.category, 15).amount(t.amount, 10)
+             .text(t.description).newline();
+            found = true;
         }
+        w.flush();
         if (!found) {
             cout << "No transactions found in this amount range.\n";
         }
@@ -317,6 +5619,7 @@ public:
     // ===== 11. SEARCH BY KEYWORD =====
     // Time Complexity: O(n)
     void searchByKeyword(const string& keyword) const {
+        EXPENSE_METRIC_SCOPE(METRIC_KEYWORD);
         cout << "\n" << string(60, '=') << "\n";
         cout << "SEARCH RESULTS FOR: \"" << keyword << "\"\n";
         cout << string(60, '=') << "\n";
@@ -325,17 +5628,16 @@ public:
         cout << string(45, '-') << "\n";
         
         cout << fixed << setprecision(2);
+        Query q;
+        q.keyword = keyword;
         bool found = false;
-        for (const auto& t : transactions) {
-            // Case-insensitive search
-            if (t.description.find(keyword) != string::npos) {
-                cout << left << setw(5) << t.id
-                     << setw(15) << t.category 
-                     << setw(10) << "₹" + to_string(t.amount)
-                     << t.description << "\n";
-                found = true;
-            }
+        ReportWriter w;
+        for (const auto& t : query(q)) {
+            w.integer(t.id, 5).text(t.category, 15).amount(t.amount, 10)
+             .text(t.description).newline();
+            found = true;
         }
+        w.flush();
         if (!found) {
             cout << "No transactions found with keyword: " << keyword << "\n";
         }
@@ -346,11 +5648,11 @@ public:
     // Time Complexity: O(n)
     double getTotalIncome() const {
         double total = 0;
-        for (const auto& t : transactions) {
+        forEachLive([&total](const Transaction& t) {
             if (t.type == "Income") {
                 total += t.amount;
             }
-        }
+        });
         return total;
     }
 
@@ -358,21 +5660,23 @@ public:
     // Time Complexity: O(n)
     double getTotalExpenses() const {
         double total = 0;
-        for (const auto& t : transactions) {
+        forEachLive([&total](const Transaction& t) {
             if (t.type == "Expense") {
                 total += t.amount;
             }
-        }
+        });
         return total;
     }
 
     // ===== 14. GET TRANSACTION COUNT =====
     int getTransactionCount() const {
-        return transactions.size();
+        return liveCount;
     }
 
     // ===== 15. DISPLAY STATISTICS =====
     void showStatistics() const {
+        EXPENSE_METRIC_SCOPE(METRIC_STATISTICS);
+        ensureIndexes();
         cout << "\n" << string(60, '=') << "\n";
         cout << "STATISTICS\n";
         cout << string(60, '=') << "\n";
@@ -384,6 +5688,911 @@ public:
         cout << "Categories: " << categoryMap.size() << "\n";
         cout << "\n";
     }
+
+    // ===== 16. PLANNED QUERY =====
+    // Time Complexity: O(log n + k) on an index path, O(n) on a scan
+    vector<Transaction> query(const Query& q) const {
+        EXPENSE_METRIC_SCOPE(METRIC_QUERY);
+        QueryPlan plan = planQuery(q);
+        return runQuery(q, plan);
+    }
+
+    // ===== 17. EXPLAIN QUERY =====
+    // Runs the query and reports the chosen plan with actual rows touched
+    QueryPlan explain(const Query& q) const {
+        QueryPlan plan = planQuery(q);
+        runQuery(q, plan);
+
+        cout << "\n" << string(60, '=') << "\n";
+        cout << "QUERY PLAN\n";
+        cout << string(60, '=') << "\n";
+        cout << fixed << setprecision(2);
+        cout << "Access Path: " << pathName(plan.path) << "\n";
+        cout << "Estimated Rows: " << plan.estimatedRows << "\n";
+        cout << "Estimated Cost: " << plan.estimatedCost
+             << " (full scan: " << transactions.size() << ")\n";
+        cout << "Rows Touched: " << plan.rowsTouched << "\n";
+        cout << "Rows Returned: " << plan.rowsReturned << "\n";
+        cout << "\n";
+        return plan;
+    }
+
+    // ===== 18. PAGINATED QUERY =====
+    // Time Complexity: O(log n + page size) with a cursor, O(offset) extra without
+    Page queryPage(const Query& q, const PageRequest& req) const {
+        return collectPage(q, req);
+    }
+
+    // ===== 19. PAGINATED LISTINGS =====
+    // Print one page and return the cursor for the next one
+    Page showPage(const Query& q, const PageRequest& req) const {
+        Page page = collectPage(q, req);
+
+        cout << "\n" << string(85, '=') << "\n";
+        cout << "TRANSACTIONS (PAGE OF " << req.limit << ")\n";
+        cout << string(85, '=') << "\n";
+        cout << left << setw(5) << "ID" << setw(12) << "Date" 
+             << setw(15) << "Category" << setw(10) << "Amount" 
+             << setw(20) << "Description" << "Type\n";
+        cout << string(72, '-') << "\n";
+
+        ReportWriter w;
+        for (const auto& t : page.rows) {
+            w.integer(t.id, 5).date(t.date, 12).text(t.category, 15)
+             .amount(t.amount, 10).text(t.description, 20).text(t.type).newline();
+        }
+        w.flush();
+        if (page.rows.empty()) {
+            cout << "No transactions on this page.\n";
+        } else if (page.hasMore) {
+            cout << "More available after ID " << page.next.afterId << "\n";
+        }
+        cout << "\n";
+        return page;
+    }
+
+    Page showAll(const PageRequest& req) const {
+        return showPage(Query(), req);
+    }
+
+    Page showByCategory(const string& category, const PageRequest& req) const {
+        Query q;
+        q.category = category;
+        return showPage(q, req);
+    }
+
+    Page searchByDateRange(const Date& start, const Date& end, const PageRequest& req) const {
+        Query q;
+        q.hasDateRange = true;
+        q.start = start;
+        q.end = end;
+        return showPage(q, req);
+    }
+
+    Page searchByAmountRange(double minAmount, double maxAmount, const PageRequest& req) const {
+        Query q;
+        q.hasAmountRange = true;
+        q.minAmount = minAmount;
+        q.maxAmount = maxAmount;
+        return showPage(q, req);
+    }
+
+    Page searchByKeyword(const string& keyword, const PageRequest& req) const {
+        Query q;
+        q.keyword = keyword;
+        return showPage(q, req);
+    }
+
+    // ===== 20. SAVE SNAPSHOT =====
+    // Time Complexity: O(n) - columns are written as flat arrays
+    bool save(const string& path) const {
+        EXPENSE_METRIC_SCOPE(METRIC_SAVE);
+        SnapshotImage image = snapshotImage();
+        if (!withFileIo([&](IoBackend& io) { return image.write(path, io); })) {
+            cout << "✗ Cannot write snapshot: " << path << "\n";
+            return false;
+        }
+        cout << "✓ Snapshot saved (" << image.header.rowCount << " transactions)\n";
+        return true;
+    }
+
+    // ===== 21. LOAD SNAPSHOT =====
+    // Time Complexity: O(n) column decode, no text parsing; indexes are
+    // rebuilt lazily on first use. Replaces the current state and clears undo.
+    // The mapping stays open: string fields point straight into its dictionary.
+    bool load(const string& path, bool verifyChecksums = true) {
+        EXPENSE_METRIC_SCOPE(METRIC_LOAD);
+        auto mapping = make_shared<MappedFile>();
+        MappedFile& file = *mapping;
+        if (!file.open(path) || file.size() < sizeof(SnapshotHeader)) {
+            cout << "✗ Cannot open snapshot: " << path << "\n";
+            return false;
+        }
+        SnapshotHeader h;
+        memcpy(&h, file.data(), sizeof(h));
+        bool valid = memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) == 0
+                  && h.version == SNAPSHOT_VERSION
+                  && h.headerChecksum == crc32(&h, offsetof(SnapshotHeader, headerChecksum));
+        for (int sec = 0; valid && sec < SEC_COUNT; ++sec) {
+            valid = h.offset[sec] % 8 == 0 && h.bytes[sec] <= file.size() && h.offset[sec] <= file.size() - h.bytes[sec]
+                 && (!verifyChecksums || h.checksum[sec] == crc32(file.data() + h.offset[sec], h.bytes[sec]));
+        }
+        // Column sizes, dictionary codes and ids are checked with or without
+        // checksums: the rows index straight into the dictionary, and the
+        // dense id map is sized from the ids
+        uint64_t n = h.rowCount;
+        valid = valid && h.nextId >= 1 && n <= file.size() / sizeof(int32_t)
+                      && h.bytes[SEC_ID] == n * sizeof(int32_t) && h.bytes[SEC_DATE] == n * sizeof(int32_t)
+                      && h.bytes[SEC_AMOUNT] == n * sizeof(double) && h.bytes[SEC_CATEGORY] == n * sizeof(uint32_t)
+                      && h.bytes[SEC_TYPE] == n * sizeof(uint32_t) && h.bytes[SEC_DESC] == n * sizeof(uint32_t);
+        vector<string_view> dict;
+        valid = valid && unpackDictionary(file.data() + h.offset[SEC_DICT], h.bytes[SEC_DICT], h.dictCount, dict);
+
+        auto column = [&](int sec) { return file.data() + h.offset[sec]; };
+        const int32_t* ids = reinterpret_cast<const int32_t*>(column(SEC_ID));
+        const int32_t* dates = reinterpret_cast<const int32_t*>(column(SEC_DATE));
+        const double* amounts = reinterpret_cast<const double*>(column(SEC_AMOUNT));
+        const uint32_t* cats = reinterpret_cast<const uint32_t*>(column(SEC_CATEGORY));
+        const uint32_t* types = reinterpret_cast<const uint32_t*>(column(SEC_TYPE));
+        const uint32_t* descs = reinterpret_cast<const uint32_t*>(column(SEC_DESC));
+        int32_t lastId = 0;
+        for (uint64_t i = 0; valid && i < n; ++i) {
+            valid = ids[i] > lastId && ids[i] < h.nextId && Date::fromKey(dates[i]).isValid()
+                 && validAmount(amounts[i]) && cats[i] < h.dictCount && types[i] < h.dictCount
+                 && descs[i] < h.dictCount;
+            lastId = ids[i];
+        }
+        if (!valid) {
+            cout << "✗ Corrupt snapshot: " << path << "\n";
+            return false;
+        }
+
+        categoryMap.clear();
+        transactions.clear();
+        undoStack.clear();
+        redoStack.clear();
+        groupDepth = 0;
+        pinnedIds.clear();
+        strings.release();
+        pinnedSnapshots.assign(1, mapping);
+        transactions.reserve(h.rowCount);
+        for (uint64_t i = 0; i < h.rowCount; ++i) {
+            transactions.push_back({ids[i], Date::fromKey(dates[i]), dict[cats[i]], amounts[i],
+                                    dict[descs[i]], dict[types[i]]});
+        }
+        liveBits.assign((h.rowCount + 63) / 64, ~uint64_t(0));
+        if (h.rowCount % 64) liveBits.back() = (uint64_t(1) << (h.rowCount % 64)) - 1;
+        liveCount = h.rowCount;
+        compacting = false;
+        nextId = h.nextId;
+        walGeneration = h.walGeneration;
+        slotOf.clear();
+        dateIndex.clear();
+        amountIndex.clear();
+        monthHistogram.clear();
+        categoryBitmaps.clear();
+        typeBitmaps.clear();
+        monthBitmaps.clear();
+        for (auto& entry : views) entry.second.clear();
+        amountQuantiles.clear();
+        rowArchive.resize(1);
+        ledgerState = VersionTrie(&historyPool);
+        versions.assign(1, ledgerState);          // version 0; ensureIndexes() records its rows
+        firstVersion = 0;
+        indexesBuilt = false;
+
+        cout << "✓ Snapshot loaded (" << h.rowCount << " transactions)\n";
+        return true;
+    }
+
+    // ===== 22. IMPORT CSV =====
+    // Time Complexity: O(file size / threads) parse + O(rows) batch add.
+    // The file is read in one batch of large reads and cut into per-thread
+    // chunks on line boundaries; fields stay string_views into the buffer
+    // until the batch add copies them.
+    ImportResult importCsv(const string& path, bool hasHeader = true, unsigned threads = 0) {
+        EXPENSE_METRIC_SCOPE(METRIC_IMPORT);
+        ImportResult result;
+        size_t fileSize;
+        unique_ptr<char[]> file = withFileIo([&](IoBackend& io) { return csvReadFile(path, fileSize, io); });
+        if (!file) {
+            cout << "✗ Cannot open CSV file: " << path << "\n";
+            return result;
+        }
+        string_view text(file.get(), fileSize);
+        if (hasHeader) {
+            size_t eol = text.find('\n');
+            text.remove_prefix(eol == string_view::npos ? text.size() : eol + 1);
+        }
+
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+        threads = (unsigned)min<size_t>(threads, text.size() / (1 << 20) + 1);   // >= 1 MiB per chunk
+        vector<string_view> chunks;
+        while (!text.empty()) {
+            size_t cut = min(text.size(), max<size_t>(1, text.size() / (threads - chunks.size())));
+            size_t eol = text.find('\n', cut - 1);
+            cut = (eol == string_view::npos || chunks.size() + 1 == threads) ? text.size() : eol + 1;
+            chunks.push_back(text.substr(0, cut));
+            text.remove_prefix(cut);
+        }
+
+        struct ChunkResult {
+            vector<CsvRow> rows;
+            size_t lines = 0, rejected = 0, firstBad = 0;
+        };
+        vector<ChunkResult> parsed(chunks.size());
+        auto parseChunk = [&](size_t c) {
+            string_view rest = chunks[c];
+            ChunkResult& out = parsed[c];
+            while (!rest.empty()) {
+                size_t eol = rest.find('\n');
+                string_view line = rest.substr(0, eol);
+                rest.remove_prefix(eol == string_view::npos ? rest.size() : eol + 1);
+                ++out.lines;
+                if (line.empty() || line == "\r") continue;
+                CsvRow row;
+                if (csvParseRow(line, row)) {
+                    out.rows.push_back(row);
+                } else if (out.rejected++ == 0) {
+                    out.firstBad = out.lines;
+                }
+            }
+        };
+        vector<thread> workers;
+        for (size_t c = 1; c < chunks.size(); ++c) workers.emplace_back(parseChunk, c);
+        if (!chunks.empty()) parseChunk(0);
+        for (auto& w : workers) w.join();
+
+        vector<Transaction> batch;
+        deque<string> unescaped;     // rare fields containing "" escapes
+        auto field = [&unescaped](string_view raw) {
+            if (raw.find("\"\"") == string_view::npos) return raw;
+            unescaped.push_back(csvUnescape(raw));
+            return string_view(unescaped.back());
+        };
+        size_t lineBase = hasHeader ? 1 : 0;
+        for (const auto& chunk : parsed) {
+            if (chunk.rejected > 0 && result.firstBadLine == 0) result.firstBadLine = lineBase + chunk.firstBad;
+            lineBase += chunk.lines;
+            result.rowsRead += chunk.rows.size() + chunk.rejected;
+            result.rowsRejected += chunk.rejected;
+            batch.reserve(batch.size() + chunk.rows.size());
+            for (const auto& r : chunk.rows) {
+                batch.push_back({0, r.date, field(r.category), r.amount, field(r.description), r.type});
+            }
+        }
+        // A batch the log refuses is not added at all
+        if (batch.empty() || addTransactions(batch) != 0) result.rowsImported = batch.size();
+        if (result.rowsRejected > 0) {
+            cout << "✗ " << result.rowsRejected << " invalid rows skipped (first at line "
+                 << result.firstBadLine << ")\n";
+        }
+        return result;
+    }
+
+    // ===== 23. OPEN DURABLE LEDGER =====
+    // Loads the last snapshot (if any), replays the WAL on top of it and
+    // logs every later add / delete / undo to walPath.
+    bool openDurable(const string& snapPath, const string& walPath, const WalOptions& opts = WalOptions()) {
+        error_code ec;
+        if (filesystem::exists(snapPath, ec) && !load(snapPath)) return false;
+        snapshotPath = snapPath;
+        wal.reset();
+
+        ensureIndexes();
+        size_t replayed = 0;
+        bool ok = WriteAheadLog::replay(walPath, walGeneration, replayed,
+            [this](WalRecordType type, const char* p, size_t) { replayRecord(type, p); });
+        if (!ok) {
+            cout << "✗ Cannot read write-ahead log: " << walPath << "\n";
+            return false;
+        }
+
+        wal.reset(new WriteAheadLog());
+        if (!wal->open(walPath, opts, walGeneration)) {
+            wal.reset();
+            cout << "✗ Cannot open write-ahead log: " << walPath << "\n";
+            return false;
+        }
+        cout << "✓ Ledger opened (" << replayed << " log records replayed)\n";
+        return true;
+    }
+
+    // ===== 24. CHECKPOINT =====
+    // Writes a snapshot that supersedes the log, then truncates the log.
+    // A crash in between is safe: the old log's generation marks it stale.
+    // This is also how a failed log recovers, as the snapshot holds every
+    // change the log lost.
+    bool checkpoint() {
+        EXPENSE_METRIC_SCOPE(METRIC_CHECKPOINT);
+        if (!wal) {
+            cout << "✗ No write-ahead log attached.\n";
+            return false;
+        }
+        bool logged = wal->sync();
+        ++walGeneration;
+        if (!save(snapshotPath)) {
+            --walGeneration;
+            if (!logged) cout << "✗ Cannot write write-ahead log: " << wal->filePath() << "\n";
+            return false;
+        }
+        if (!wal->truncate(walGeneration)) {
+            cout << "✗ Cannot write write-ahead log: " << wal->filePath() << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // ===== 25. SYNC LOG =====
+    // Forces any group-commit batch to disk; false if it could not be
+    bool syncLog() {
+        if (!wal || wal->sync()) return true;
+        cout << "✗ Cannot write write-ahead log: " << wal->filePath() << "\n";
+        return false;
+    }
+
+    // ===== 25b. LOG HEALTH =====
+    // Time Complexity: O(1)
+    // False once a log write or fsync has failed; mutations are refused
+    // until a checkpoint succeeds
+    bool logHealthy() const {
+        return !wal || wal->healthy();
+    }
+
+    // ===== 25c. GROUP COMMIT TIMER =====
+    // Time Complexity: O(1), plus one fsync when a group is due
+    // Syncs the pending group commit once its time window has passed. Call
+    // it every few milliseconds: without new mutations nothing else does.
+    bool syncLogIfDue() {
+        if (!wal) return true;
+        bool wasHealthy = wal->healthy();
+        if (wal->syncIfDue()) return true;
+        if (wasHealthy) cout << "✗ Cannot write write-ahead log: " << wal->filePath() << "\n";
+        return false;
+    }
+
+    // ===== 26. UNDO MEMORY BUDGET =====
+    // Caps the in-memory undo journal at `bytes`; older entries spill to
+    // spillPath, or are forgotten when no spill file is given.
+    bool setUndoBudget(size_t bytes, const string& spillPath = "") {
+        if (!undoStack.configure(bytes, spillPath)) {
+            cout << "✗ Cannot open undo spill file: " << spillPath << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // ===== 27. CURRENT VERSION =====
+    // Time Complexity: O(1)
+    // Every add, batch add, delete, undo, redo and restore commits one
+    // version. Numbering restarts at 0 when a snapshot is loaded.
+    size_t currentVersion() const {
+        ensureIndexes();
+        return firstVersion + versions.size() - 1;
+    }
+
+    // ===== 28. TIME-TRAVEL QUERY =====
+    // Time Complexity: O(rows in that version) - one ordered walk of its
+    // trie, no replay. Rows come back in id order.
+    vector<Transaction> queryAsOf(size_t version, const Query& q) const {
+        EXPENSE_METRIC_SCOPE(METRIC_QUERY_AS_OF);
+        vector<Transaction> result;
+        const VersionTrie* state = findVersion(version);
+        if (!state) {
+            cout << "✗ Version " << version << " is not in the history.\n";
+            return result;
+        }
+        size_t scanned = 0;
+        state->forEach([&](uint32_t, uint32_t entry) {
+            if (!(entry & ROW_LIVE)) return;
+            ++scanned;
+            const Transaction& t = rowArchive[entry & ~ROW_LIVE];
+            if (q.matches(t)) result.push_back(t);
+        });
+        EXPENSE_METRIC_ROWS(scanned, result.size());
+        return result;
+    }
+
+    // ===== 29. RESTORE VERSION =====
+    // Time Complexity: O(d log n) for d rows that differ - subtrees shared
+    // with the target version are skipped
+    // The jump is a single undo unit, so undo() returns to the present.
+    bool restoreVersion(size_t version) {
+        EXPENSE_METRIC_SCOPE(METRIC_RESTORE);
+        if (!logWritable()) return false;
+        const VersionTrie* target = findVersion(version);
+        if (!target) {
+            cout << "✗ Version " << version << " is not in the history.\n";
+            return false;
+        }
+
+        finishCompaction();
+        vector<UndoOp> ops;
+        vector<Transaction> missing;
+        VersionTrie::diff(ledgerState, *target, [&](uint32_t id, uint32_t now, uint32_t then) {
+            bool liveNow = now & ROW_LIVE, liveThen = then & ROW_LIVE;
+            if (liveNow && !liveThen) {
+                ops.push_back({DELETE_OP, (int)id});
+                return;
+            }
+            if (!liveThen) return;
+            if (!liveNow) {
+                // Reviving works like redoing the row's ADD
+                ops.push_back({ADD, (int)id});
+                if (anySlot(id) == NO_SLOT) missing.push_back(rowArchive[(now ? now : then) & ~ROW_LIVE]);
+            }
+            if (((now ^ then) & ~ROW_LIVE) != 0) ops.push_back({UPDATE, (int)(then & ~ROW_LIVE)});
+        });
+        if (ops.empty()) {
+            cout << "✓ Ledger already matches version " << version << ".\n";
+            return true;
+        }
+
+        if (!logUnit(WAL_RESTORE, ops)) return false;
+        clearRedo();
+        if (!missing.empty()) storeInsertOrdered(move(missing));
+        applyUnit(ops, false);
+        pushUndoUnit(ops);
+        maybeCompact();
+        commitVersion();
+        maybeCheckpoint();
+        cout << "✓ Ledger restored to version " << version << " (" << ops.size() << " rows changed)\n";
+        return true;
+    }
+
+    // ===== 30. HISTORY LIMIT =====
+    // Keeps only the newest `count` versions (at least the current one).
+    // Dropping a version frees the trie nodes no newer version shares;
+    // archived rows are kept.
+    void setHistoryLimit(size_t count) {
+        ensureIndexes();
+        historyLimit = max<size_t>(1, count);
+        while (versions.size() > historyLimit) {
+            versions.pop_front();
+            ++firstVersion;
+        }
+    }
+
+    // ===== 31. SHOW METRICS =====
+    // Per-operation latency percentiles and rows scanned / returned, then
+    // how often each access path served a query. Metrics are process-wide:
+    // they cover every ledger and every thread.
+    void showMetrics() const {
+#ifdef EXPENSE_NO_METRICS
+        cout << "✗ Metrics are compiled out (EXPENSE_NO_METRICS).\n";
+#else
+        MetricsSnapshot m = metricsSnapshot();
+        cout << "\n" << string(95, '=') << "\n";
+        cout << "OPERATION METRICS (latency in µs)\n";
+        cout << string(95, '=') << "\n";
+        cout << left << setw(22) << "Operation" << setw(10) << "Calls" << setw(10) << "p50"
+             << setw(10) << "p99" << setw(10) << "p99.9" << setw(11) << "Max"
+             << setw(12) << "Scanned" << "Returned\n";
+        cout << string(95, '-') << "\n";
+
+        ReportWriter w;
+        for (int i = 0; i < METRIC_OP_COUNT; ++i) {
+            const OperationMetrics& op = m.ops[i];
+            if (op.calls == 0) continue;
+            w.text(METRIC_OP_NAMES[i], 22).integer(op.calls, 10)
+             .number(op.percentile(50) / 1000.0, 2, 10).number(op.percentile(99) / 1000.0, 2, 10)
+             .number(op.percentile(99.9) / 1000.0, 2, 10).number(op.maxNs / 1000.0, 2, 11)
+             .integer(op.rowsScanned, 12).integer(op.rowsReturned).newline();
+        }
+        w.flush();
+
+        cout << "\n" << left << setw(22) << "Access Path" << setw(10) << "Queries"
+             << setw(14) << "Rows Touched" << setw(15) << "Rows Returned" << "Hit Rate\n";
+        cout << string(70, '-') << "\n";
+        uint64_t planned = 0, indexed = 0;
+        for (int p = 0; p < ACCESS_PATH_COUNT; ++p) {
+            const AccessPathMetrics& path = m.paths[p];
+            planned += path.queries;
+            if (p != FULL_SCAN) indexed += path.queries;
+            double hitRate = path.rowsTouched ? 100.0 * path.rowsReturned / path.rowsTouched : 0;
+            w.text(pathName((AccessPath)p), 22).integer(path.queries, 10).integer(path.rowsTouched, 14)
+             .integer(path.rowsReturned, 15).number(hitRate, 1).text("%").newline();
+        }
+        w.flush();
+        cout << fixed << setprecision(1);
+        cout << "\nIndex Hit Rate: " << (planned ? 100.0 * indexed / planned : 0.0)
+             << "% of " << planned << " planned queries used an index\n\n";
+#endif
+    }
+
+    // ===== 32. DUMP METRICS =====
+    // The same numbers as one JSON object on a single line; histograms list
+    // [bucket lower bound in ns, count] for every non-empty bucket
+    void dumpMetrics(ostream& out) const {
+        ReportWriter w(out);
+#ifdef EXPENSE_NO_METRICS
+        w.text("{\"enabled\":false}").newline();
+#else
+        MetricsSnapshot m = metricsSnapshot();
+        w.text("{\"enabled\":true,\"operations\":[");
+        bool first = true;
+        for (int i = 0; i < METRIC_OP_COUNT; ++i) {
+            const OperationMetrics& op = m.ops[i];
+            if (op.calls == 0) continue;
+            if (!first) w.text(",");
+            first = false;
+            w.text("{\"name\":\"").text(METRIC_OP_NAMES[i])
+             .text("\",\"calls\":").integer(op.calls)
+             .text(",\"totalNs\":").integer(op.totalNs)
+             .text(",\"maxNs\":").integer(op.maxNs)
+             .text(",\"p50Ns\":").integer(op.percentile(50))
+             .text(",\"p99Ns\":").integer(op.percentile(99))
+             .text(",\"p999Ns\":").integer(op.percentile(99.9))
+             .text(",\"rowsScanned\":").integer(op.rowsScanned)
+             .text(",\"rowsReturned\":").integer(op.rowsReturned)
+             .text(",\"histogram\":[");
+            bool firstBucket = true;
+            for (size_t b = 0; b < op.latency.size(); ++b) {
+                if (op.latency[b] == 0) continue;
+                if (!firstBucket) w.text(",");
+                firstBucket = false;
+                w.text("[").integer(LatencyBuckets::lowerBound(b)).text(",").integer(op.latency[b]).text("]");
+            }
+            w.text("]}");
+        }
+        w.text("],\"accessPaths\":[");
+        for (int p = 0; p < ACCESS_PATH_COUNT; ++p) {
+            if (p > 0) w.text(",");
+            w.text("{\"path\":\"").text(pathName((AccessPath)p))
+             .text("\",\"queries\":").integer(m.paths[p].queries)
+             .text(",\"rowsTouched\":").integer(m.paths[p].rowsTouched)
+             .text(",\"rowsReturned\":").integer(m.paths[p].rowsReturned).text("}");
+        }
+        w.text("]}").newline();
+#endif
+    }
+
+    // ===== 33. MEMORY USAGE =====
+    // Time Complexity: O(n + trie nodes) - history nodes are walked once to
+    // count the ones versions share
+    MemoryUsage memoryUsage() const {
+        ensureIndexes();
+        MemoryUsage usage;
+        auto add = [&usage](const char* name, size_t used, size_t reserved) {
+            usage.components.push_back({name, used, reserved});
+            usage.usedBytes += used;
+            usage.reservedBytes += reserved;
+        };
+        auto vectorBytes = [](const auto& v) {
+            using T = typename decay_t<decltype(v)>::value_type;
+            return make_pair(v.size() * sizeof(T), v.capacity() * sizeof(T));
+        };
+
+        auto rows = vectorBytes(transactions);
+        add("transactions", rows.first, rows.second);
+        auto bits = vectorBytes(liveBits);
+        add("live bitmap", bits.first, bits.second);
+        auto slots = vectorBytes(slotOf);
+        add("slot map", slots.first, slots.second);
+
+        // Pool-backed indexes: node sizes are estimates, the pool total is exact
+        size_t pooled = 0;
+        auto addIndex = [&](const char* name, size_t used) {
+            add(name, used, used);
+            pooled += used;
+        };
+        size_t listBytes = 0;
+        for (const auto& entry : categoryMap) listBytes += entry.second.capacity() * sizeof(int);
+        addIndex("category map",
+                 categoryMap.bucket_count() * sizeof(void*) + listBytes +
+                 categoryMap.size() * (sizeof(*categoryMap.begin()) + HASH_NODE_OVERHEAD));
+        addIndex("date index", dateIndex.size() * (sizeof(*dateIndex.begin()) + TREE_NODE_OVERHEAD));
+        addIndex("amount index", amountIndex.size() * (sizeof(*amountIndex.begin()) + TREE_NODE_OVERHEAD));
+        addIndex("month histogram",
+                 monthHistogram.size() * (sizeof(*monthHistogram.begin()) + TREE_NODE_OVERHEAD));
+        addIndex("pinned tombstones",
+                 pinnedIds.bucket_count() * sizeof(void*) + pinnedIds.size() * (sizeof(int) + HASH_NODE_OVERHEAD));
+        size_t poolHeld = indexUpstream.bytesHeld();
+        add("index pool slack", 0, poolHeld > pooled ? poolHeld - pooled : 0);
+        size_t bitmapBytes = 0;
+        for (const auto& entry : categoryBitmaps) bitmapBytes += entry.second.memoryBytes() + sizeof(entry) + HASH_NODE_OVERHEAD;
+        for (const auto& entry : typeBitmaps) bitmapBytes += entry.second.memoryBytes() + sizeof(entry) + HASH_NODE_OVERHEAD;
+        for (const auto& entry : monthBitmaps) bitmapBytes += entry.second.memoryBytes() + sizeof(entry) + TREE_NODE_OVERHEAD;
+        add("bitmap indexes", bitmapBytes, bitmapBytes);
+        size_t viewBytes = 0;
+        for (const auto& entry : views) viewBytes += entry.second.memoryBytes() + entry.first.capacity() + TREE_NODE_OVERHEAD;
+        add("materialized views", viewBytes, viewBytes);
+
+        add("undo journal", undoStack.memoryBytes(), undoStack.capacityBytes());
+        usage.undoSpilledBytes = undoStack.spilledBytes();
+        auto redo = vectorBytes(redoStack);
+        add("redo stack", redo.first, redo.second);
+        auto unit = vectorBytes(unitScratch);
+        auto walBuf = vectorBytes(walScratch);
+        auto quantiles = vectorBytes(amountQuantiles);
+        auto dates = vectorBytes(batchDates);
+        auto amounts = vectorBytes(batchAmounts);
+        add("scratch buffers", unit.first + walBuf.first + quantiles.first + dates.first + amounts.first,
+            unit.second + walBuf.second + quantiles.second + dates.second + amounts.second);
+
+        size_t internBytes = strings.internedBucketCount() * sizeof(void*) +
+                             strings.internedCount() * (sizeof(string_view) + HASH_NODE_OVERHEAD);
+        add("string heap", strings.bytesUsed() + internBytes, strings.bytesReserved() + internBytes);
+
+        auto archive = vectorBytes(rowArchive);
+        add("row archive", archive.first, archive.second);
+        unordered_set<const void*> nodes;
+        ledgerState.collectNodes(nodes);
+        for (const VersionTrie& v : versions) v.collectNodes(nodes);
+        size_t trieBytes = nodes.size() * VersionTrie::NODE_BYTES;
+        size_t historyBytes = trieBytes + versions.size() * sizeof(VersionTrie);
+        add("version history", historyBytes, max(historyBytes, historyUpstream.bytesHeld()));
+
+        for (const auto& entry : categoryMap) {
+            CategoryMemory c;
+            c.category = string(entry.first);
+            c.rows = entry.second.size();
+            c.listBytes = entry.second.capacity() * sizeof(int);
+            for (int id : entry.second) {
+                uint32_t slot = liveSlot(id);
+                if (slot == NO_SLOT) continue;
+                ++c.liveRows;
+                c.stringBytes += transactions[slot].description.size();
+            }
+            usage.categories.push_back(move(c));
+        }
+        sort(usage.categories.begin(), usage.categories.end(),
+             [](const CategoryMemory& a, const CategoryMemory& b) { return a.listBytes + a.stringBytes > b.listBytes + b.stringBytes; });
+        return usage;
+    }
+
+    // ===== 34. SHOW MEMORY USAGE =====
+    void showMemoryUsage() const {
+        MemoryUsage usage = memoryUsage();
+        cout << "\n" << string(60, '=') << "\n";
+        cout << "MEMORY USAGE (bytes)\n";
+        cout << string(60, '=') << "\n";
+        cout << left << setw(22) << "Component" << setw(16) << "Used" << "Reserved\n";
+        cout << string(50, '-') << "\n";
+        ReportWriter w;
+        for (const MemoryComponent& c : usage.components) {
+            w.text(c.name, 22).integer(c.usedBytes, 16).integer(c.reservedBytes).newline();
+        }
+        w.text("Total", 22).integer(usage.usedBytes, 16).integer(usage.reservedBytes).newline();
+        if (usage.undoSpilledBytes) {
+            w.text("Undo spilled to disk: ").integer(usage.undoSpilledBytes).newline();
+        }
+        w.flush();
+
+        cout << "\n" << left << setw(20) << "Category" << setw(10) << "Rows" << setw(10) << "Live"
+             << setw(12) << "List" << "Strings\n";
+        cout << string(60, '-') << "\n";
+        for (const CategoryMemory& c : usage.categories) {
+            w.text(c.category, 20).integer(c.rows, 10).integer(c.liveRows, 10)
+             .integer(c.listBytes, 12).integer(c.stringBytes).newline();
+        }
+        w.flush();
+        cout << "\n";
+    }
+
+    // ===== 35. COMPACT =====
+    // Time Complexity: O(n log n) - reclaims every unpinned tombstone, then
+    // rebuilds the indexes into a fresh pool and trims vector capacity.
+    // Strings stay in the arena: the version history may still point at them.
+    void compact() {
+        ensureIndexes();
+        finishCompaction();
+        if (transactions.size() > liveCount + pinnedIds.size()) {
+            compacting = true;
+            compactRead = compactWrite = 0;
+            finishCompaction();
+        }
+        size_t before = memoryUsage().reservedBytes;
+
+        rebuildIndexPool();
+        transactions.shrink_to_fit();
+        liveBits.shrink_to_fit();
+        slotOf.shrink_to_fit();
+        rowArchive.shrink_to_fit();
+        redoStack.shrink_to_fit();
+        unitScratch.shrink_to_fit();
+        walScratch.shrink_to_fit();
+        batchDates.shrink_to_fit();
+        batchAmounts.shrink_to_fit();
+        versions.shrink_to_fit();
+        undoStack.shrink();
+
+        size_t after = memoryUsage().reservedBytes;
+        cout << "✓ Compacted: " << (before > after ? before - after : 0) << " bytes released ("
+             << after << " bytes reserved)\n";
+    }
+
+#ifdef EXPENSE_HAS_COROUTINES
+    // ===== 36. ASYNC QUERY =====
+    // Time Complexity: O(n) in chunks of ASYNC_SCAN_CHUNK ids, yielding to
+    // the executor between chunks; one step when an index path is selective.
+    // A row changed while the scan is suspended is seen as of the chunk that
+    // reads it. Call only from coroutines running on executor.
+    Task<vector<Transaction>> queryAsync(AsyncExecutor& executor, Query q) const {
+        QueryPlan plan = planQuery(q);
+        if (plan.path != FULL_SCAN && plan.estimatedRows <= ASYNC_SCAN_CHUNK) {
+            co_return runQuery(q, plan);
+        }
+        vector<Transaction> rows;
+        int endId = nextId;
+        for (int from = 1; from < endId; from += ASYNC_SCAN_CHUNK) {
+            if (from > 1) co_await executor.yield();
+            ensureIndexes();
+            int to = min(endId, from + ASYNC_SCAN_CHUNK);
+            for (int id = from; id < to; ++id) {
+                uint32_t slot = liveSlot(id);
+                if (slot != NO_SLOT && q.matches(transactions[slot])) rows.push_back(transactions[slot]);
+            }
+        }
+        co_return rows;
+    }
+
+    Task<vector<Transaction>> searchAsync(AsyncExecutor& executor, string keyword) const {
+        Query q;
+        q.keyword = move(keyword);
+        return queryAsync(executor, move(q));
+    }
+
+    // ===== 37. ASYNC SAVE =====
+    // Time Complexity: O(n) - the columns are copied on the executor thread,
+    // then checksums and the file write run on a helper thread
+    Task<bool> saveAsync(AsyncExecutor& executor, string path) const {
+        SnapshotImage image = snapshotImage();
+        bool ok = co_await executor.offload([this, &image, &path] {
+            return withFileIo([&](IoBackend& io) { return image.write(path, io); });
+        });
+        if (!ok) {
+            cout << "✗ Cannot write snapshot: " << path << "\n";
+            co_return false;
+        }
+        cout << "✓ Snapshot saved (" << image.header.rowCount << " transactions)\n";
+        co_return true;
+    }
+#endif
+
+    // ===== 38. EXPORT SEGMENTS =====
+    // Time Complexity: O(n) - live rows in id order, rowsPerSegment per file.
+    // Segments left in dir from an earlier export are removed afterwards;
+    // query them with a SegmentStore.
+    bool exportSegments(const string& dir, size_t rowsPerSegment = SEGMENT_ROWS) const {
+        error_code ec;
+        filesystem::create_directories(dir, ec);
+        if (ec || rowsPerSegment == 0) {
+            cout << "✗ Cannot export segments to: " << dir << "\n";
+            return false;
+        }
+        vector<Transaction> rows;
+        rows.reserve(min<size_t>(liveCount, rowsPerSegment));
+        set<string> written;
+        bool ok = true;
+        auto flush = [&] {
+            char name[32];
+            snprintf(name, sizeof(name), "segment-%06zu.eseg", written.size());
+            string path = (filesystem::path(dir) / name).string();
+            ok = ok && withFileIo([&](IoBackend& io) { return writeSegment(path, rows.data(), rows.size(), io); });
+            written.insert(path);
+            rows.clear();
+        };
+        forEachLive([&](const Transaction& t) {
+            rows.push_back(t);
+            if (rows.size() == rowsPerSegment) flush();
+        });
+        if (!rows.empty()) flush();
+        if (!ok) {
+            cout << "✗ Cannot export segments to: " << dir << "\n";
+            return false;
+        }
+        vector<filesystem::path> stale;
+        for (const auto& entry : filesystem::directory_iterator(dir, ec)) {
+            if (entry.path().extension() == ".eseg" && !written.count(entry.path().string())) {
+                stale.push_back(entry.path());
+            }
+        }
+        for (const auto& path : stale) filesystem::remove(path, ec);
+        cout << "✓ Exported " << liveCount << " transactions into " << written.size() << " segments\n";
+        return true;
+    }
+
+    // ===== 39. BITMAP QUERY =====
+    // Time Complexity: O(c + k) - c bitmap containers combined, then only
+    // the k matching rows are read, in id order
+    vector<Transaction> bitmapQuery(const BitmapQuery& b) const {
+        EXPENSE_METRIC_SCOPE(METRIC_BITMAP_QUERY);
+        ensureIndexes();
+        vector<Transaction> result;
+        bool constrained;
+        RoaringBitmap ids = matchBitmaps(b, constrained);
+        if (!constrained) {
+            result.reserve(liveCount);
+            forEachLive([&result](const Transaction& t) { result.push_back(t); });
+            EXPENSE_METRIC_ROWS(transactions.size(), result.size());
+            return result;
+        }
+        result.reserve(ids.cardinality());
+        ids.forEach([&](uint32_t id) { result.push_back(transactions[liveSlot((int)id)]); });
+        EXPENSE_METRIC_ROWS(result.size(), result.size());
+        return result;
+    }
+
+    // ===== 40. BITMAP COUNT =====
+    // Time Complexity: O(c) - no row is read
+    size_t bitmapCount(const BitmapQuery& b) const {
+        EXPENSE_METRIC_SCOPE(METRIC_BITMAP_COUNT);
+        ensureIndexes();
+        bool constrained;
+        RoaringBitmap ids = matchBitmaps(b, constrained);
+        return constrained ? ids.cardinality() : liveCount;
+    }
+
+    // ===== 41. CREATE VIEW =====
+    // Time Complexity: O(n log g) to fill it; after that every mutation
+    // costs O(log g) per view
+    bool createView(const string& name, const ViewDefinition& def) {
+        if (name.empty() || def.aggregates.empty()) {
+            cout << "✗ A view needs a name and at least one aggregate\n";
+            return false;
+        }
+        if (views.count(name)) {
+            cout << "✗ View already exists: " << name << "\n";
+            return false;
+        }
+        ensureIndexes();
+        MaterializedView& view = views.emplace(name, MaterializedView(def)).first->second;
+        forEachLive([&view](const Transaction& t) { view.apply(t, 1); });
+        cout << "✓ View " << name << " created (" << view.groupCount() << " groups)\n";
+        return true;
+    }
+
+    // ===== 42. DROP VIEW =====
+    bool dropView(const string& name) {
+        if (!views.erase(name)) {
+            cout << "✗ No view named: " << name << "\n";
+            return false;
+        }
+        cout << "✓ View " << name << " dropped\n";
+        return true;
+    }
+
+    // ===== 43. READ VIEW =====
+    // Time Complexity: O(g) - groups come out in key order, nothing is rescanned
+    bool readView(const string& name, vector<ViewRow>& out) const {
+        ensureIndexes();
+        auto it = views.find(name);
+        if (it == views.end()) {
+            out.clear();
+            return false;
+        }
+        it->second.read(out);
+        return true;
+    }
+
+    // ===== 44. SHOW VIEW =====
+    void showView(const string& name) const {
+        vector<ViewRow> rows;
+        if (!readView(name, rows)) {
+            cout << "✗ No view named: " << name << "\n";
+            return;
+        }
+        const ViewDefinition& def = views.at(name).definition();
+        cout << "\n" << string(60, '=') << "\n";
+        cout << "VIEW: " << name << "\n";
+        cout << string(60, '=') << "\n";
+        ReportWriter w;
+        for (GroupKey key : def.groupBy) w.text(MaterializedView::keyName(key), 15);
+        for (AggregateFunc f : def.aggregates) w.text(MaterializedView::aggregateName(f), 12);
+        w.newline().text(string(15 * def.groupBy.size() + 12 * def.aggregates.size(), '-')).newline();
+        for (const ViewRow& row : rows) {
+            for (const string& key : row.keys) w.text(key, 15);
+            for (size_t i = 0; i < row.values.size(); ++i) {
+                if (def.aggregates[i] == AGG_COUNT) w.integer((long long)row.values[i], 12);
+                else w.number(row.values[i], 2, 12);
+            }
+            w.newline();
+        }
+        w.flush();
+        if (rows.empty()) cout << "No rows.\n";
+        cout << "\n";
+    }
 };
 
 // ============= HELPER FUNCTION =============
@@ -392,6 +6601,9 @@ Date makeDate(int day, int month, int year) {
 }
 
 // ============= MAIN DEMO =============
+// Define EXPENSE_NO_MAIN to compile this file into another program, as the
+// benchmark suite does.
+#ifndef EXPENSE_NO_MAIN
 int main() {
     ExpenseManager manager;
 
@@ -434,6 +6646,20 @@ int main() {
     // ===== SEARCH: KEYWORD =====
     manager.searchByKeyword("Food");
 
+    // ===== QUERY PLANNER: EXPLAIN =====
+    Query planned;
+    planned.category = "Food";
+    planned.hasAmountRange = true;
+    planned.minAmount = 500;
+    planned.maxAmount = 1000;
+    manager.explain(planned);
+
+    // ===== PAGINATION: KEYSET CURSOR =====
+    PageRequest pageReq;
+    pageReq.limit = 4;
+    Page firstPage = manager.showAll(pageReq);
+    manager.showAll(firstPage.next);
+
     // ===== MONTHLY TOTAL =====
     double nov_total = manager.getMonthlyTotal(11, 2025, "Expense");
     cout << "\n" << string(60, '=') << "\n";
@@ -450,4 +6676,5 @@ int main() {
     cout << string(60, '=') << "\n\n";
 
     return 0;
-}
\ No newline at end of file
+}
+#endif
\ No newline at end of file
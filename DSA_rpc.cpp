@@ -0,0 +1,519 @@
+// ============= EXPENSE MANAGER BINARY RPC =============
+// Length-prefixed binary frames over a Unix domain socket, for ingest
+// feeders that would spend more time on JSON than on the ledger.
+//
+// Server: expense_server --rpc /tmp/expense.sock        (DSA_server.cpp)
+// Bench:  g++ -std=c++17 -O2 -pthread DSA_rpc.cpp -o expense_rpc
+//         ./expense_rpc bench [--socket PATH] [--rows N] [--batch N] [--connections N]
+//
+// Without --socket the benchmark serves a private ledger from in-process
+// threads over a loopback Unix socket, so it measures the protocol and the
+// batch add path on their own.
+//
+// Frame: a 12-byte header {u32 body bytes, u16 type, u16 reserved,
+// u32 sequence} followed by the body. All integers are little-endian.
+//   ADD_BATCH  u32 rows, then per row: i32 date key (yyyymmdd), f64 amount,
+//              u16 category bytes, u16 type bytes, u16 description bytes,
+//              then the three strings back to back
+//   DELETE     i32 id
+//   UNDO       empty
+//   PING       empty
+// Every request gets exactly one reply with the same sequence, in order:
+//   ACK        i32 value (first id / deleted id / 1 for undo), u32 rows
+//   ERROR      UTF-8 message
+#ifndef EXPENSE_NO_MAIN
+#define EXPENSE_NO_MAIN
+#endif
+#ifndef EXPENSE_NO_WORKLOAD_MAIN
+#define EXPENSE_NO_WORKLOAD_MAIN
+#endif
+#include "DSA_workload.cpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// ============= WIRE FORMAT =============
+enum RpcFrameType : uint16_t {
+    RPC_ADD_BATCH = 1,
+    RPC_DELETE = 2,
+    RPC_UNDO = 3,
+    RPC_PING = 4,
+    RPC_ACK = 0x81,
+    RPC_ERROR = 0x82,
+};
+
+struct RpcHeader {
+    uint32_t bodyBytes;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t sequence;
+};
+
+static_assert(sizeof(RpcHeader) == 12, "RpcHeader must match the wire layout");
+
+const size_t RPC_MAX_BODY = 64 << 20;
+const size_t RPC_ROW_FIXED = sizeof(int32_t) + sizeof(double) + 3 * sizeof(uint16_t);
+
+// Unaligned little-endian reads and writes (the supported hosts are all
+// little-endian, so these are plain copies)
+template <typename T>
+T rpcGet(const char*& p) {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+template <typename T>
+void rpcPut(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void rpcPutFrame(string& out, RpcFrameType type, uint32_t sequence, string_view body) {
+    rpcPut(out, RpcHeader{(uint32_t)body.size(), type, 0, sequence});
+    out.append(body.data(), body.size());
+}
+
+void rpcPutAck(string& out, uint32_t sequence, int32_t value, uint32_t rows) {
+    rpcPut(out, RpcHeader{sizeof(int32_t) + sizeof(uint32_t), RPC_ACK, 0, sequence});
+    rpcPut(out, value);
+    rpcPut(out, rows);
+}
+
+// ============= SERVER SIDE =============
+// Decodes every complete frame in `in`, appending one reply per frame to
+// `out`, and drops the consumed bytes. Batch rows stay string_views into
+// `in` until addTransactions() copies them into the ledger's arena, so no
+// per-row strings are built. Back-to-back ADD_BATCH frames that arrived
+// together go into one addTransactions() call, since a bigger batch makes
+// the sorted index inserts cheaper per row. withLedger(f) must call
+// f(ExpenseManager&) under whatever lock guards the ledger.
+// Returns false on a malformed frame; the connection should then be closed.
+class RpcHandler {
+private:
+    vector<Transaction> batch;                   // rows of the pending frames
+    vector<pair<uint32_t, uint32_t>> pending;    // (sequence, rows) per frame
+
+    // Appends a frame's rows to batch; on failure batch is left as it was
+    bool decodeBatch(const char* p, const char* end) {
+        size_t before = batch.size();
+        if (!decodeRows(p, end)) {
+            batch.resize(before);
+            return false;
+        }
+        return true;
+    }
+
+    bool decodeRows(const char* p, const char* end) {
+        if (end - p < (ptrdiff_t)sizeof(uint32_t)) return false;
+        uint32_t rows = rpcGet<uint32_t>(p);
+        if (rows > (size_t)(end - p) / RPC_ROW_FIXED) return false;
+        batch.reserve(batch.size() + rows);
+        for (uint32_t i = 0; i < rows; ++i) {
+            if (end - p < (ptrdiff_t)RPC_ROW_FIXED) return false;
+            Transaction t;
+            t.id = 0;
+            t.date = Date::fromKey(rpcGet<int32_t>(p));
+            t.amount = rpcGet<double>(p);
+            uint16_t categoryBytes = rpcGet<uint16_t>(p);
+            uint16_t typeBytes = rpcGet<uint16_t>(p);
+            uint16_t descBytes = rpcGet<uint16_t>(p);
+            if (end - p < (ptrdiff_t)categoryBytes + typeBytes + descBytes) return false;
+            t.category = string_view(p, categoryBytes);
+            t.type = string_view(p + categoryBytes, typeBytes);
+            t.description = string_view(p + categoryBytes + typeBytes, descBytes);
+            p += categoryBytes + typeBytes + descBytes;
+            // Same rules as the CSV importer
+            if (!t.date.isValid() || t.category.empty() || !validAmount(t.amount)) return false;
+            batch.push_back(t);
+        }
+        return p == end;
+    }
+
+    // Adds the pending frames' rows and acknowledges each frame
+    template <typename WithLedger>
+    void applyPending(string& out, WithLedger& withLedger) {
+        if (pending.empty()) return;
+        int firstId = 0;
+        withLedger([&](ExpenseManager& ledger) { firstId = ledger.addTransactions(batch); });
+        for (const auto& frame : pending) {
+            // Only a failing log makes a non-empty batch return 0
+            if (frame.second && firstId == 0) {
+                rpcPutFrame(out, RPC_ERROR, frame.first, "write-ahead log is failing");
+                continue;
+            }
+            rpcPutAck(out, frame.first, frame.second ? firstId : 0, frame.second);
+            firstId += frame.second;
+        }
+        pending.clear();
+        batch.clear();
+    }
+
+public:
+    template <typename WithLedger>
+    bool serve(string& in, string& out, WithLedger withLedger) {
+        size_t pos = 0;
+        bool ok = true;
+        while (in.size() - pos >= sizeof(RpcHeader)) {
+            RpcHeader h;
+            memcpy(&h, in.data() + pos, sizeof(h));
+            if (h.bodyBytes > RPC_MAX_BODY) {
+                ok = false;
+                break;
+            }
+            if (in.size() - pos < sizeof(RpcHeader) + h.bodyBytes) break;
+            const char* body = in.data() + pos + sizeof(RpcHeader);
+            const char* end = body + h.bodyBytes;
+            if (h.type != RPC_ADD_BATCH) applyPending(out, withLedger);
+
+            switch (h.type) {
+            case RPC_ADD_BATCH: {
+                size_t before = batch.size();
+                if (!decodeBatch(body, end)) {
+                    // Earlier frames are answered first, keeping replies in order
+                    applyPending(out, withLedger);
+                    rpcPutFrame(out, RPC_ERROR, h.sequence, "malformed batch");
+                    break;
+                }
+                pending.push_back({h.sequence, (uint32_t)(batch.size() - before)});
+                break;
+            }
+            case RPC_DELETE: {
+                if (h.bodyBytes != sizeof(int32_t)) {
+                    rpcPutFrame(out, RPC_ERROR, h.sequence, "malformed delete");
+                    break;
+                }
+                int32_t id = rpcGet<int32_t>(body);
+                bool deleted = false, logged = true;
+                withLedger([&](ExpenseManager& ledger) {
+                    deleted = ledger.deleteTransaction(id);
+                    logged = ledger.logHealthy();
+                });
+                if (deleted) rpcPutAck(out, h.sequence, id, 1);
+                else rpcPutFrame(out, RPC_ERROR, h.sequence, logged ? "transaction not found" : "write-ahead log is failing");
+                break;
+            }
+            case RPC_UNDO: {
+                bool undone = false, logged = true;
+                withLedger([&](ExpenseManager& ledger) {
+                    undone = ledger.undo();
+                    logged = ledger.logHealthy();
+                });
+                if (undone) rpcPutAck(out, h.sequence, 1, 0);
+                else rpcPutFrame(out, RPC_ERROR, h.sequence, logged ? "nothing to undo" : "write-ahead log is failing");
+                break;
+            }
+            case RPC_PING:
+                rpcPutAck(out, h.sequence, 0, 0);
+                break;
+            default:
+                rpcPutFrame(out, RPC_ERROR, h.sequence, "unknown frame type");
+                break;
+            }
+            pos += sizeof(RpcHeader) + h.bodyBytes;
+        }
+        applyPending(out, withLedger);
+        in.erase(0, pos);
+        return ok;
+    }
+};
+
+// ============= CLIENT LIBRARY =============
+// Blocking client. add() appends to a batch that is sent once it holds
+// batchRows rows; up to `window` frames may be in flight before the client
+// waits for an acknowledgement. Any failure is sticky: error() says why.
+class ExpenseRpcClient {
+private:
+    int fd = -1;
+    size_t batchRows;
+    size_t window;
+    string batch;                 // the open ADD_BATCH frame, header included
+    uint32_t batchCount = 0;
+    uint32_t nextSequence = 1;
+    size_t inFlight = 0;
+    uint64_t acked = 0;
+    int32_t lastValue = 0;
+    string failure;
+    string rejection;
+    string reply;
+
+    bool fail(string message) {
+        if (failure.empty()) failure = move(message);
+        return false;
+    }
+
+    bool sendAll(const char* p, size_t n) {
+        while (n > 0) {
+            ssize_t sent = send(fd, p, n, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent <= 0) return fail(string("send: ") + strerror(errno));
+            p += sent;
+            n -= sent;
+        }
+        return true;
+    }
+
+    bool recvAll(char* p, size_t n) {
+        while (n > 0) {
+            ssize_t got = recv(fd, p, n, 0);
+            if (got < 0 && errno == EINTR) continue;
+            if (got <= 0) return fail(got == 0 ? "server closed the connection" : string("recv: ") + strerror(errno));
+            p += got;
+            n -= got;
+        }
+        return true;
+    }
+
+    // Reads one reply; an ERROR reply is recorded but does not stop the stream
+    bool readReply(bool& accepted) {
+        RpcHeader h;
+        if (!recvAll(reinterpret_cast<char*>(&h), sizeof(h))) return false;
+        if (h.bodyBytes > RPC_MAX_BODY) return fail("oversized reply");
+        reply.resize(h.bodyBytes);
+        if (!recvAll(&reply[0], h.bodyBytes)) return false;
+        --inFlight;
+        accepted = h.type == RPC_ACK && h.bodyBytes == sizeof(int32_t) + sizeof(uint32_t);
+        if (!accepted) {
+            rejection = reply;
+            return true;
+        }
+        const char* p = reply.data();
+        lastValue = rpcGet<int32_t>(p);
+        acked += rpcGet<uint32_t>(p);
+        return true;
+    }
+
+    bool sendFrame(string& frame) {
+        bool accepted;
+        while (inFlight >= window) {
+            if (!readReply(accepted)) return false;
+        }
+        if (!sendAll(frame.data(), frame.size())) return false;
+        ++inFlight;
+        return true;
+    }
+
+    void openBatch() {
+        batch.clear();
+        batch.resize(sizeof(RpcHeader) + sizeof(uint32_t));
+        batchCount = 0;
+    }
+
+    // Sends one frame after draining the pipeline and returns its reply
+    bool call(RpcFrameType type, string_view body) {
+        if (!flush() || !sync()) return false;
+        string frame;
+        rpcPutFrame(frame, type, nextSequence++, body);
+        bool accepted;
+        return sendFrame(frame) && readReply(accepted) && accepted;
+    }
+
+public:
+    explicit ExpenseRpcClient(size_t rowsPerBatch = 4096, size_t framesInFlight = 8)
+        : batchRows(max<size_t>(1, rowsPerBatch)), window(max<size_t>(1, framesInFlight)) {
+        openBatch();
+    }
+
+    ~ExpenseRpcClient() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    ExpenseRpcClient(const ExpenseRpcClient&) = delete;
+    ExpenseRpcClient& operator=(const ExpenseRpcClient&) = delete;
+
+    bool connect(const string& path) {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) return fail("socket path too long");
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.data(), path.size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            return fail("connect " + path + ": " + strerror(errno));
+        }
+        return true;
+    }
+
+    bool add(const Date& date, string_view category, double amount, string_view desc, string_view type) {
+        if (!failure.empty()) return false;
+        if (category.size() > UINT16_MAX || type.size() > UINT16_MAX || desc.size() > UINT16_MAX) {
+            return fail("field longer than 65535 bytes");
+        }
+        rpcPut<int32_t>(batch, date.key());
+        rpcPut<double>(batch, amount);
+        rpcPut<uint16_t>(batch, (uint16_t)category.size());
+        rpcPut<uint16_t>(batch, (uint16_t)type.size());
+        rpcPut<uint16_t>(batch, (uint16_t)desc.size());
+        batch.append(category.data(), category.size());
+        batch.append(type.data(), type.size());
+        batch.append(desc.data(), desc.size());
+        if (++batchCount >= batchRows || batch.size() >= RPC_MAX_BODY / 2) return flush();
+        return true;
+    }
+
+    // Sends the open batch, if any, without waiting for its reply
+    bool flush() {
+        if (!failure.empty()) return false;
+        if (batchCount == 0) return true;
+        RpcHeader h{(uint32_t)(batch.size() - sizeof(RpcHeader)), RPC_ADD_BATCH, 0, nextSequence++};
+        memcpy(&batch[0], &h, sizeof(h));
+        memcpy(&batch[sizeof(h)], &batchCount, sizeof(batchCount));
+        bool ok = sendFrame(batch);
+        openBatch();
+        return ok;
+    }
+
+    // Flushes and waits until every frame sent so far is acknowledged
+    bool sync() {
+        if (!flush()) return false;
+        bool accepted;
+        while (inFlight > 0) {
+            if (!readReply(accepted)) return false;
+        }
+        return true;
+    }
+
+    bool deleteTransaction(int id) {
+        string body;
+        rpcPut<int32_t>(body, id);
+        return call(RPC_DELETE, body);
+    }
+
+    bool undo() { return call(RPC_UNDO, string_view()); }
+    bool ping() { return call(RPC_PING, string_view()); }
+
+    uint64_t rowsAcknowledged() const { return acked; }
+    int32_t lastAckValue() const { return lastValue; }    // first id of the last acknowledged batch
+    const string& error() const { return failure; }
+    const string& lastRejection() const { return rejection; }    // most recent ERROR reply
+};
+
+// Listening Unix socket; an existing socket file at path is replaced
+int rpcListen(const string& path, bool nonBlocking) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | (nonBlocking ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// ============= LOOPBACK BENCHMARK =============
+#ifndef EXPENSE_NO_RPC_MAIN
+// One blocking thread per accepted connection, sharing one ledger
+static void serveLoopback(int listenFd, size_t connections, ExpenseManager& ledger) {
+    mutex ledgerLock;
+    vector<thread> sessions;
+    for (size_t i = 0; i < connections; ++i) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) break;
+        sessions.emplace_back([fd, &ledger, &ledgerLock] {
+            RpcHandler handler;
+            string in, out;
+            vector<char> buf(1 << 20);
+            auto withLedger = [&](auto f) {
+                lock_guard<mutex> guard(ledgerLock);
+                f(ledger);
+            };
+            while (true) {
+                ssize_t n = recv(fd, buf.data(), buf.size(), 0);
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                in.append(buf.data(), n);
+                if (!handler.serve(in, out, withLedger)) break;
+                if (!out.empty() && send(fd, out.data(), out.size(), MSG_NOSIGNAL) != (ssize_t)out.size()) break;
+                out.clear();
+            }
+            ::close(fd);
+        });
+    }
+    for (thread& t : sessions) t.join();
+}
+
+static int rpcUsage() {
+    cerr << "Usage: expense_rpc bench [--socket PATH] [--rows N] [--batch N] [--connections N]\n";
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || string_view(argv[1]) != "bench") return rpcUsage();
+    string socketPath;
+    int rows = 2000000, batchRows = 16384, connections = 1;
+    for (int i = 2; i < argc; ++i) {
+        string_view arg = argv[i];
+        int* target = arg == "--rows" ? &rows : arg == "--batch" ? &batchRows : arg == "--connections" ? &connections : nullptr;
+        if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (target && i + 1 < argc && csvParseInt(argv[i + 1], *target) && *target > 0) {
+            ++i;
+        } else {
+            return rpcUsage();
+        }
+    }
+
+    // Rows are generated up front so the clock only sees encode, send and ingest
+    vector<vector<Transaction>> work(connections);
+    vector<unique_ptr<WorkloadGenerator>> generators;
+    for (int c = 0; c < connections; ++c) {
+        generators.push_back(make_unique<WorkloadGenerator>(100 + c));
+        work[c].reserve(rows / connections + 1);
+        for (int r = c; r < rows; r += connections) work[c].push_back(generators[c]->row());
+    }
+
+    ExpenseManager ledger;
+    ledger.setHistoryLimit(1);
+    thread server;
+    int listenFd = -1;
+    unique_ptr<QuietOutput> quiet;
+    if (socketPath.empty()) {
+        socketPath = "/tmp/expense_rpc_bench." + to_string(getpid()) + ".sock";
+        listenFd = rpcListen(socketPath, false);
+        if (listenFd < 0) {
+            cerr << "✗ Cannot listen on " << socketPath << ": " << strerror(errno) << "\n";
+            return 1;
+        }
+        quiet.reset(new QuietOutput());
+        server = thread(serveLoopback, listenFd, (size_t)connections, ref(ledger));
+    }
+
+    atomic<bool> failed{false};
+    auto start = chrono::steady_clock::now();
+    vector<thread> clients;
+    for (int c = 0; c < connections; ++c) {
+        clients.emplace_back([&, c] {
+            ExpenseRpcClient client(batchRows);
+            bool ok = client.connect(socketPath);
+            for (const Transaction& t : work[c]) {
+                if (!ok) break;
+                ok = client.add(t.date, t.category, t.amount, t.description, t.type);
+            }
+            ok = ok && client.sync();
+            if (!ok || client.rowsAcknowledged() != work[c].size()) {
+                cerr << "✗ Client " << c << ": " << (client.error().empty() ? client.lastRejection() : client.error()) << "\n";
+                failed = true;
+            }
+        });
+    }
+    for (thread& t : clients) t.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    if (server.joinable()) {
+        server.join();
+        ::close(listenFd);
+        unlink(socketPath.c_str());
+        quiet.reset();
+    }
+    if (failed) return 1;
+
+    cout << fixed << setprecision(0);
+    cout << "✓ " << rows << " rows in batches of " << batchRows << " over " << connections
+         << " connection(s): " << rows / seconds << " rows/s\n";
+    if (listenFd >= 0) cout << "Ledger rows: " << ledger.getTransactionCount() << "\n";
+    return 0;
+}
+#endif
@@ -0,0 +1,860 @@
+// ============= EXPENSE MANAGER HTTP SERVER =============
+// Serves one ledger as JSON over HTTP/1.1 on localhost (Linux, epoll).
+//
+// Build:  g++ -std=c++17 -O2 -pthread DSA_server.cpp -o expense_server
+// Run:    ./expense_server [--port 8080] [--threads N] [--durable SNAPSHOT WAL]
+//                          [--rpc SOCKET]
+//
+// Endpoints (parameters go in the query string; POST also accepts them as a
+// flat JSON object body; dates are d/m/yyyy or yyyy-mm-dd):
+//   POST   /transactions          date, category, amount, [type], [description]
+//   DELETE /transactions/<id>
+//   POST   /undo, /redo
+//   GET    /transactions          [category] [type] [from] [to] [min] [max]
+//                                 [keyword] [limit] [after] - planned query,
+//                                 id order, keyset-paged via "next"
+//   GET    /top                   [n]
+//   GET    /totals
+//   GET    /totals/monthly        month, year, [type]
+//   GET    /metrics               same JSON as dumpMetrics()
+//
+// Every worker runs its own epoll loop on the shared listening socket and
+// owns the connections it accepts. Connections are keep-alive and may
+// pipeline requests; responses go back in request order. Ledger calls are
+// serialized by one mutex, while parsing and JSON encoding run in parallel.
+//
+// With --rpc the same workers also accept binary RPC connections on a Unix
+// socket (wire format in DSA_rpc.cpp), sharing the ledger and its lock.
+#ifndef EXPENSE_NO_RPC_MAIN
+#define EXPENSE_NO_RPC_MAIN
+#endif
+#include "DSA_rpc.cpp"
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+// ============= JSON WRITER =============
+// Appends compact JSON to a string; commas are inserted automatically
+class JsonWriter {
+private:
+    string& out;
+    vector<bool> first;     // per open container: nothing written yet
+    bool afterKey = false;
+
+    void separate() {
+        if (afterKey) {
+            afterKey = false;
+            return;
+        }
+        if (!first.empty()) {
+            if (!first.back()) out += ',';
+            first.back() = false;
+        }
+    }
+
+    void quoted(string_view s) {
+        static const char HEX[] = "0123456789abcdef";
+        out += '"';
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char)c < 0x20) {
+                out += "\\u00";
+                out += HEX[(c >> 4) & 0xF];
+                out += HEX[c & 0xF];
+            } else {
+                out += c;
+            }
+        }
+        out += '"';
+    }
+
+public:
+    explicit JsonWriter(string& buffer) : out(buffer) {}
+
+    JsonWriter& beginObject() { separate(); out += '{'; first.push_back(true); return *this; }
+    JsonWriter& endObject() { out += '}'; first.pop_back(); return *this; }
+    JsonWriter& beginArray() { separate(); out += '['; first.push_back(true); return *this; }
+    JsonWriter& endArray() { out += ']'; first.pop_back(); return *this; }
+
+    JsonWriter& key(string_view k) {
+        separate();
+        quoted(k);
+        out += ':';
+        afterKey = true;
+        return *this;
+    }
+
+    JsonWriter& text(string_view s) { separate(); quoted(s); return *this; }
+    JsonWriter& boolean(bool v) { separate(); out += v ? "true" : "false"; return *this; }
+    JsonWriter& null() { separate(); out += "null"; return *this; }
+
+    JsonWriter& integer(long long v) {
+        separate();
+        char buf[24];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+        return *this;
+    }
+
+    // Shortest text that reads back as the same double
+    JsonWriter& number(double v) {
+        separate();
+        char buf[32];
+        out.append(buf, to_chars(buf, buf + sizeof(buf), v).ptr);
+        return *this;
+    }
+
+    // ISO yyyy-mm-dd
+    JsonWriter& date(const Date& d) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%04d-%02d-%02d", d.year, d.month, d.day);
+        return text(buf);
+    }
+
+    JsonWriter& row(const Transaction& t) {
+        beginObject();
+        key("id").integer(t.id);
+        key("date").date(t.date);
+        key("category").text(t.category);
+        key("amount").number(t.amount);
+        key("description").text(t.description);
+        key("type").text(t.type);
+        return endObject();
+    }
+
+    JsonWriter& rows(const vector<Transaction>& list) {
+        beginArray();
+        for (const Transaction& t : list) row(t);
+        return endArray();
+    }
+};
+
+// ============= REQUEST PARAMETERS =============
+// Query-string and body parameters, decoded; later values win
+class Params {
+private:
+    vector<pair<string, string>> values;
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static string decode(string_view s) {
+        string out;
+        out.reserve(s.size());
+        for (size_t i = 0; i < s.size(); ++i) {
+            if (s[i] == '+') {
+                out += ' ';
+            } else if (s[i] == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0) {
+                out += (char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+                i += 2;
+            } else {
+                out += s[i];
+            }
+        }
+        return out;
+    }
+
+public:
+    void set(string key, string value) {
+        values.emplace_back(move(key), move(value));
+    }
+
+    // a=1&b=two
+    void parseQuery(string_view query) {
+        while (!query.empty()) {
+            size_t amp = query.find('&');
+            string_view pair = query.substr(0, amp);
+            size_t eq = pair.find('=');
+            if (!pair.empty()) {
+                set(decode(pair.substr(0, eq)), eq == string_view::npos ? string() : decode(pair.substr(eq + 1)));
+            }
+            if (amp == string_view::npos) break;
+            query.remove_prefix(amp + 1);
+        }
+    }
+
+    // {"a": 1, "b": "two", "c": true} - one level, no arrays
+    bool parseJson(string_view body) {
+        size_t i = 0;
+        auto skipSpace = [&] { while (i < body.size() && isspace((unsigned char)body[i])) ++i; };
+        auto readString = [&](string& out) {
+            if (i >= body.size() || body[i] != '"') return false;
+            for (++i; i < body.size() && body[i] != '"'; ++i) {
+                char c = body[i];
+                if (c == '\\') {
+                    if (++i >= body.size()) return false;
+                    c = body[i];
+                    if (c == 'n') c = '\n';
+                    else if (c == 't') c = '\t';
+                    else if (c == 'u') {
+                        // Only \u00XX is produced by JsonWriter; anything wider is rejected
+                        if (i + 4 >= body.size() || body[i + 1] != '0' || body[i + 2] != '0') return false;
+                        int hi = hexValue(body[i + 3]), lo = hexValue(body[i + 4]);
+                        if (hi < 0 || lo < 0) return false;
+                        c = (char)(hi * 16 + lo);
+                        i += 4;
+                    }
+                }
+                out += c;
+            }
+            if (i >= body.size()) return false;
+            ++i;
+            return true;
+        };
+
+        skipSpace();
+        if (i >= body.size() || body[i++] != '{') return false;
+        skipSpace();
+        if (i < body.size() && body[i] == '}') return true;
+        while (true) {
+            string key, value;
+            skipSpace();
+            if (!readString(key)) return false;
+            skipSpace();
+            if (i >= body.size() || body[i++] != ':') return false;
+            skipSpace();
+            if (i < body.size() && body[i] == '"') {
+                if (!readString(value)) return false;
+            } else {
+                size_t start = i;
+                while (i < body.size() && body[i] != ',' && body[i] != '}' && !isspace((unsigned char)body[i])) ++i;
+                value.assign(body.substr(start, i - start));
+                if (value.empty() || value[0] == '{' || value[0] == '[') return false;
+            }
+            set(move(key), move(value));
+            skipSpace();
+            if (i >= body.size()) return false;
+            if (body[i] == '}') return true;
+            if (body[i++] != ',') return false;
+        }
+    }
+
+    const string* find(string_view key) const {
+        for (auto it = values.rbegin(); it != values.rend(); ++it) {
+            if (it->first == key) return &it->second;
+        }
+        return nullptr;
+    }
+};
+
+// ============= ROUTER =============
+struct Response {
+    int status = 200;
+    string body;
+};
+
+class ExpenseService {
+private:
+    ExpenseManager& ledger;
+    mutex ledgerLock;
+
+    static const size_t DEFAULT_PAGE = 100;
+    static const size_t MAX_PAGE = 10000;
+
+    static Response error(int status, string_view message) {
+        Response r;
+        r.status = status;
+        JsonWriter(r.body).beginObject().key("error").text(message).endObject();
+        return r;
+    }
+
+    // Finite values only: a NaN would corrupt the amount index's ordering
+    static bool readDouble(const Params& p, string_view key, double& value) {
+        const string* s = p.find(key);
+        if (!s) return false;
+        auto res = from_chars(s->data(), s->data() + s->size(), value);
+        return res.ec == errc() && res.ptr == s->data() + s->size() && isfinite(value);
+    }
+
+    static bool readInt(const Params& p, string_view key, int& value) {
+        const string* s = p.find(key);
+        return s && csvParseInt(*s, value);
+    }
+
+    // Fills q from the filter parameters; returns the offending key on error
+    static const char* readQuery(const Params& p, Query& q) {
+        if (const string* s = p.find("category")) q.category = *s;
+        if (const string* s = p.find("type")) q.type = *s;
+        if (const string* s = p.find("keyword")) q.keyword = *s;
+        const string* from = p.find("from");
+        const string* to = p.find("to");
+        if (from || to) {
+            q.hasDateRange = true;
+            q.start = {1, 1, 1};
+            q.end = {31, 12, 9999};
+            if (from && !csvParseDate(*from, q.start)) return "from";
+            if (to && !csvParseDate(*to, q.end)) return "to";
+        }
+        bool hasMin = p.find("min"), hasMax = p.find("max");
+        if (hasMin || hasMax) {
+            q.hasAmountRange = true;
+            q.minAmount = -numeric_limits<double>::infinity();
+            q.maxAmount = numeric_limits<double>::infinity();
+            if (hasMin && !readDouble(p, "min", q.minAmount)) return "min";
+            if (hasMax && !readDouble(p, "max", q.maxAmount)) return "max";
+        }
+        return nullptr;
+    }
+
+    Response addTransaction(const Params& p) {
+        Date date;
+        double amount;
+        const string* category = p.find("category");
+        const string* dateText = p.find("date");
+        if (!dateText || !csvParseDate(*dateText, date)) return error(400, "missing or invalid date");
+        if (!category || category->empty()) return error(400, "missing category");
+        if (!readDouble(p, "amount", amount) || !validAmount(amount)) return error(400, "missing or invalid amount");
+        const string* type = p.find("type");
+        const string* desc = p.find("description");
+
+        int id;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            id = ledger.addTransaction(date, *category, amount, desc ? *desc : string_view(),
+                                       type ? *type : string_view("Expense"));
+        }
+        if (id == 0) return error(503, "write-ahead log is failing");
+        Response r;
+        r.status = 201;
+        JsonWriter(r.body).beginObject().key("id").integer(id).endObject();
+        return r;
+    }
+
+    Response deleteTransaction(string_view idText) {
+        int id;
+        if (!csvParseInt(idText, id)) return error(400, "invalid id");
+        bool deleted, logged;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            deleted = ledger.deleteTransaction(id);
+            logged = ledger.logHealthy();
+        }
+        if (!logged) return error(503, "write-ahead log is failing");
+        if (!deleted) return error(404, "transaction not found");
+        Response r;
+        JsonWriter(r.body).beginObject().key("deleted").integer(id).endObject();
+        return r;
+    }
+
+    Response undoRedo(bool undo) {
+        bool done, logged;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            done = undo ? ledger.undo() : ledger.redo();
+            logged = ledger.logHealthy();
+        }
+        if (!logged) return error(503, "write-ahead log is failing");
+        if (!done) return error(409, undo ? "nothing to undo" : "nothing to redo");
+        Response r;
+        JsonWriter(r.body).beginObject().key(undo ? "undone" : "redone").boolean(true).endObject();
+        return r;
+    }
+
+    Response listTransactions(const Params& p) {
+        Query q;
+        if (const char* bad = readQuery(p, q)) return error(400, string("invalid ") + bad);
+        PageRequest req;
+        req.limit = DEFAULT_PAGE;
+        int n;
+        if (p.find("limit")) {
+            if (!readInt(p, "limit", n) || n <= 0) return error(400, "invalid limit");
+            req.limit = min<size_t>(n, MAX_PAGE);
+        }
+        if (p.find("after")) {
+            if (!readInt(p, "after", n)) return error(400, "invalid after");
+            req.hasCursor = true;
+            req.afterId = n;
+        }
+
+        Page page;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            page = ledger.queryPage(q, req);
+        }
+        Response r;
+        JsonWriter w(r.body);
+        w.beginObject().key("rows").rows(page.rows).key("next");
+        if (page.hasMore) w.integer(page.next.afterId);
+        else w.null();
+        w.endObject();
+        return r;
+    }
+
+    Response top(const Params& p) {
+        int n = 5;
+        if (p.find("n") && (!readInt(p, "n", n) || n <= 0)) return error(400, "invalid n");
+        vector<Transaction> rows;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            rows = ledger.topExpenses(min<int>(n, MAX_PAGE));
+        }
+        Response r;
+        JsonWriter(r.body).beginObject().key("rows").rows(rows).endObject();
+        return r;
+    }
+
+    Response totals() {
+        double income, expenses;
+        int count;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            income = ledger.getTotalIncome();
+            expenses = ledger.getTotalExpenses();
+            count = ledger.getTransactionCount();
+        }
+        Response r;
+        JsonWriter(r.body).beginObject()
+            .key("count").integer(count)
+            .key("income").number(income)
+            .key("expenses").number(expenses)
+            .key("net").number(income - expenses)
+            .endObject();
+        return r;
+    }
+
+    Response monthlyTotal(const Params& p) {
+        int month, year;
+        if (!readInt(p, "month", month) || month < 1 || month > 12) return error(400, "invalid month");
+        if (!readInt(p, "year", year)) return error(400, "invalid year");
+        const string* type = p.find("type");
+        double total;
+        {
+            lock_guard<mutex> guard(ledgerLock);
+            total = ledger.getMonthlyTotal(month, year, type ? *type : string());
+        }
+        Response r;
+        JsonWriter(r.body).beginObject().key("total").number(total).endObject();
+        return r;
+    }
+
+    Response metrics() {
+        ostringstream out;
+        ledger.dumpMetrics(out);
+        Response r;
+        r.body = out.str();
+        if (!r.body.empty() && r.body.back() == '\n') r.body.pop_back();
+        return r;
+    }
+
+public:
+    explicit ExpenseService(ExpenseManager& manager) : ledger(manager) {}
+
+    // Runs f(ledger) under the ledger lock; the RPC handler's entry point
+    template <typename F>
+    void withLedger(F f) {
+        lock_guard<mutex> guard(ledgerLock);
+        f(ledger);
+    }
+
+    void syncLogIfDue() {
+        lock_guard<mutex> guard(ledgerLock);
+        ledger.syncLogIfDue();
+    }
+
+    Response handle(string_view method, string_view path, const Params& p) {
+        const string_view item = "/transactions/";
+        if (path == "/transactions") {
+            if (method == "GET") return listTransactions(p);
+            if (method == "POST") return addTransaction(p);
+            return error(405, "method not allowed");
+        }
+        if (path.substr(0, item.size()) == item) {
+            if (method == "DELETE") return deleteTransaction(path.substr(item.size()));
+            return error(405, "method not allowed");
+        }
+        if (path == "/undo" || path == "/redo") {
+            if (method == "POST") return undoRedo(path == "/undo");
+            return error(405, "method not allowed");
+        }
+        if (method != "GET") return error(method == "POST" ? 405 : 404, "not found");
+        if (path == "/top") return top(p);
+        if (path == "/totals") return totals();
+        if (path == "/totals/monthly") return monthlyTotal(p);
+        if (path == "/metrics") return metrics();
+        return error(404, "not found");
+    }
+};
+
+// ============= HTTP CONNECTIONS =============
+static const size_t MAX_HEADER_BYTES = 64 << 10;
+static const size_t MAX_BODY_BYTES = 1 << 20;
+static const size_t MAX_PENDING_OUTPUT = 4 << 20;   // stop reading until the client drains this
+
+struct Connection {
+    int fd;
+    string in;
+    string out;
+    size_t outSent = 0;
+    bool closeAfterWrite = false;
+    bool reading = true;     // EPOLLIN registered
+    bool rpc = false;        // binary RPC instead of HTTP
+    RpcHandler rpcHandler;
+};
+
+static const char* statusText(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 431: return "Request Header Fields Too Large";
+    case 503: return "Service Unavailable";
+    default:  return "Error";
+    }
+}
+
+static void appendResponse(Connection& c, const Response& r, bool keepAlive) {
+    char head[192];
+    int n = snprintf(head, sizeof(head),
+                     "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s\r\n",
+                     r.status, statusText(r.status), r.body.size(),
+                     keepAlive ? "" : "Connection: close\r\n");
+    c.out.append(head, n);
+    c.out += r.body;
+    if (!keepAlive) c.closeAfterWrite = true;
+}
+
+static bool headerEquals(string_view a, string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+static string_view trim(string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) s.remove_suffix(1);
+    return s;
+}
+
+// Answers every complete request in c.in, in order. Stops at the first
+// partial request, and after any request that closes the connection.
+static void serveRequests(Connection& c, ExpenseService& service) {
+    size_t pos = 0;
+    while (!c.closeAfterWrite) {
+        string_view pending(c.in.data() + pos, c.in.size() - pos);
+        size_t headerEnd = pending.find("\r\n\r\n");
+        if (headerEnd == string_view::npos) {
+            if (pending.size() > MAX_HEADER_BYTES) appendResponse(c, {431, "{\"error\":\"headers too large\"}"}, false);
+            break;
+        }
+
+        string_view head = pending.substr(0, headerEnd);
+        size_t lineEnd = head.find("\r\n");
+        string_view requestLine = head.substr(0, lineEnd);
+        size_t sp1 = requestLine.find(' ');
+        size_t sp2 = sp1 == string_view::npos ? sp1 : requestLine.find(' ', sp1 + 1);
+        if (sp2 == string_view::npos) {
+            appendResponse(c, {400, "{\"error\":\"malformed request line\"}"}, false);
+            break;
+        }
+        string_view method = requestLine.substr(0, sp1);
+        string_view target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+        string_view version = requestLine.substr(sp2 + 1);
+
+        bool keepAlive = version == "HTTP/1.1";
+        size_t contentLength = 0;
+        bool badLength = false;
+        string_view headers = lineEnd == string_view::npos ? string_view() : head.substr(lineEnd + 2);
+        while (!headers.empty()) {
+            size_t end = headers.find("\r\n");
+            string_view line = headers.substr(0, end);
+            size_t colon = line.find(':');
+            if (colon != string_view::npos) {
+                string_view name = line.substr(0, colon), value = trim(line.substr(colon + 1));
+                if (headerEquals(name, "Content-Length")) {
+                    auto res = from_chars(value.data(), value.data() + value.size(), contentLength);
+                    badLength = res.ec != errc() || res.ptr != value.data() + value.size();
+                } else if (headerEquals(name, "Connection")) {
+                    if (headerEquals(value, "close")) keepAlive = false;
+                    else if (headerEquals(value, "keep-alive")) keepAlive = true;
+                }
+            }
+            if (end == string_view::npos) break;
+            headers.remove_prefix(end + 2);
+        }
+        if (badLength || contentLength > MAX_BODY_BYTES) {
+            appendResponse(c, {badLength ? 400 : 413, "{\"error\":\"invalid body length\"}"}, false);
+            break;
+        }
+        size_t total = headerEnd + 4 + contentLength;
+        if (pending.size() < total) break;
+        string_view body = pending.substr(headerEnd + 4, contentLength);
+
+        Params params;
+        size_t question = target.find('?');
+        string_view path = target.substr(0, question);
+        if (question != string_view::npos) params.parseQuery(target.substr(question + 1));
+        Response response;
+        if (!body.empty()) {
+            // A JSON object whatever the Content-Type says (curl -d sends
+            // form-urlencoded), otherwise form fields
+            size_t start = body.find_first_not_of(" \t\r\n");
+            bool json = start != string_view::npos && body[start] == '{';
+            if (!json) params.parseQuery(body);
+            else if (!params.parseJson(body)) response = {400, "{\"error\":\"body must be a flat JSON object\"}"};
+        }
+        if (response.body.empty()) response = service.handle(method, path, params);
+        appendResponse(c, response, keepAlive);
+        pos += total;
+    }
+    c.in.erase(0, pos);
+}
+
+// ============= WORKER LOOP =============
+static atomic<bool> g_stopping{false};
+
+static void onStopSignal(int) {
+    g_stopping.store(true);
+}
+
+class Worker {
+private:
+    int listenFd;
+    int rpcFd;               // -1 without --rpc
+    int epollFd;
+    ExpenseService& service;
+    int logTickMillis;       // > 0 on the one worker that runs group-commit syncs
+    unordered_map<int, unique_ptr<Connection>> connections;
+
+    void watch(Connection& c, bool read, bool write) {
+        epoll_event ev{};
+        ev.events = EPOLLRDHUP;
+        if (read) ev.events |= EPOLLIN;
+        if (write) ev.events |= EPOLLOUT;
+        ev.data.ptr = &c;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, c.fd, &ev);
+        c.reading = read;
+    }
+
+    void close(Connection& c) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, c.fd, nullptr);
+        ::close(c.fd);
+        connections.erase(c.fd);
+    }
+
+    void acceptAll(bool rpc) {
+        while (true) {
+            int fd = accept4(rpc ? rpcFd : listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;     // EAGAIN, or another worker took it
+            int one = 1;
+            if (!rpc) setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            auto conn = make_unique<Connection>();
+            conn->fd = fd;
+            conn->rpc = rpc;
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.ptr = conn.get();
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                ::close(fd);
+                continue;
+            }
+            connections[fd] = move(conn);
+        }
+    }
+
+    // Returns false once the connection is closed
+    bool flush(Connection& c) {
+        while (c.outSent < c.out.size()) {
+            ssize_t n = send(c.fd, c.out.data() + c.outSent, c.out.size() - c.outSent, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.outSent += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                watch(c, c.out.size() - c.outSent < MAX_PENDING_OUTPUT && !c.closeAfterWrite, true);
+                return true;
+            }
+            close(c);
+            return false;
+        }
+        c.out.clear();
+        c.outSent = 0;
+        if (c.closeAfterWrite) {
+            close(c);
+            return false;
+        }
+        if (!c.reading) watch(c, true, false);
+        return true;
+    }
+
+    void onReadable(Connection& c) {
+        char buf[64 << 10];
+        bool peerClosed = false;
+        while (true) {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0) {
+                c.in.append(buf, n);
+                if ((size_t)n < sizeof(buf)) break;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            peerClosed = true;     // EOF or a hard error
+            break;
+        }
+        if (!c.rpc) serveRequests(c, service);
+        else if (!c.rpcHandler.serve(c.in, c.out, [this](auto f) { service.withLedger(f); })) c.closeAfterWrite = true;
+        if (peerClosed) c.closeAfterWrite = true;
+        flush(c);
+    }
+
+public:
+    Worker(int fd, int rpc, ExpenseService& svc, int logTick = 0)
+        : listenFd(fd), rpcFd(rpc), epollFd(epoll_create1(EPOLL_CLOEXEC)), service(svc), logTickMillis(logTick) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.ptr = nullptr;     // marks the HTTP listening socket
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        if (rpcFd >= 0) {
+            ev.data.ptr = &rpcFd;  // marks the RPC listening socket
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, rpcFd, &ev);
+        }
+    }
+
+    ~Worker() {
+        for (auto& entry : connections) ::close(entry.first);
+        ::close(epollFd);
+    }
+
+    void run() {
+        epoll_event events[256];
+        auto lastTick = chrono::steady_clock::now();
+        while (!g_stopping.load(memory_order_relaxed)) {
+            int n = epoll_wait(epollFd, events, 256, logTickMillis > 0 ? logTickMillis : 200);
+            // The log checks its group-commit window only on the next append;
+            // this tick syncs the last group of a ledger that went idle
+            if (logTickMillis > 0 && chrono::steady_clock::now() - lastTick >= chrono::milliseconds(logTickMillis)) {
+                service.syncLogIfDue();
+                lastTick = chrono::steady_clock::now();
+            }
+            for (int i = 0; i < n; ++i) {
+                if (!events[i].data.ptr || events[i].data.ptr == &rpcFd) {
+                    acceptAll(events[i].data.ptr != nullptr);
+                    continue;
+                }
+                Connection& c = *static_cast<Connection*>(events[i].data.ptr);
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close(c);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    if (!flush(c)) continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP)) onReadable(c);
+            }
+        }
+    }
+};
+
+// ============= SERVER MAIN =============
+static int listenOn(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+#ifndef EXPENSE_NO_SERVER_MAIN
+int main(int argc, char** argv) {
+    int port = 8080;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    string snapshot, log, rpcPath;
+    for (int i = 1; i < argc; ++i) {
+        string_view arg = argv[i];
+        int n;
+        if (arg == "--port" && i + 1 < argc && csvParseInt(argv[i + 1], n) && n > 0 && n < 65536) {
+            port = n;
+            ++i;
+        } else if (arg == "--threads" && i + 1 < argc && csvParseInt(argv[i + 1], n) && n > 0) {
+            threads = n;
+            ++i;
+        } else if (arg == "--durable" && i + 2 < argc) {
+            snapshot = argv[i + 1];
+            log = argv[i + 2];
+            i += 2;
+        } else if (arg == "--rpc" && i + 1 < argc) {
+            rpcPath = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--port 8080] [--threads N] [--durable SNAPSHOT WAL]"
+                 << " [--rpc SOCKET]\n";
+            return 2;
+        }
+    }
+
+    ExpenseManager ledger;
+    if (!snapshot.empty() && !ledger.openDurable(snapshot, log)) {
+        cerr << "✗ Cannot open durable ledger.\n";
+        return 1;
+    }
+
+    int listenFd = listenOn((uint16_t)port);
+    if (listenFd < 0) {
+        cerr << "✗ Cannot listen on 127.0.0.1:" << port << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    int rpcFd = -1;
+    if (!rpcPath.empty() && (rpcFd = rpcListen(rpcPath, true)) < 0) {
+        cerr << "✗ Cannot listen on " << rpcPath << ": " << strerror(errno) << "\n";
+        ::close(listenFd);
+        return 1;
+    }
+
+    // Ledger methods report to cout; the server answers over the wire instead
+    unique_ptr<QuietOutput> quiet(new QuietOutput());
+    signal(SIGINT, onStopSignal);
+    signal(SIGTERM, onStopSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    ExpenseService service(ledger);
+    vector<unique_ptr<Worker>> workers;
+    int logTick = snapshot.empty() ? 0 : WalOptions().groupCommitMillis;
+    for (unsigned i = 0; i < threads; ++i)
+        workers.push_back(make_unique<Worker>(listenFd, rpcFd, service, i == 0 ? logTick : 0));
+    cerr << "✓ Listening on http://127.0.0.1:" << port << " (" << threads << " workers)\n";
+    if (rpcFd >= 0) cerr << "✓ Accepting RPC on " << rpcPath << "\n";
+
+    vector<thread> pool;
+    for (auto& w : workers) pool.emplace_back([&w] { w->run(); });
+    for (thread& t : pool) t.join();
+    workers.clear();
+    ::close(listenFd);
+    if (rpcFd >= 0) {
+        ::close(rpcFd);
+        unlink(rpcPath.c_str());
+    }
+
+    bool synced = snapshot.empty() || ledger.syncLog();
+    quiet.reset();
+    if (!synced) {
+        cerr << "✗ Server stopped, but the write-ahead log could not be synced.\n";
+        return 1;
+    }
+    cerr << "✓ Server stopped.\n";
+    return 0;
+}
+#endif
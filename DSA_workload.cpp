@@ -0,0 +1,500 @@
+// ============= SYNTHETIC WORKLOADS =============
+// Seeded generator for reproducible operation streams, and a driver that
+// replays a stream against ExpenseManager and reports per-operation latency.
+//
+// Build:  g++ -std=c++17 -O2 -pthread DSA_workload.cpp -o expense_workload
+// Usage:  expense_workload generate [--seed N] [--ops N] [--preload N] [--skew S]
+//                                   [--mix add=40,delete=10,undo=5,query=45] > ops.tsv
+//         expense_workload replay ops.tsv        (or - for stdin)
+//
+// Streams are tab-separated text, one operation per line:
+//   preload <rows> <seed> <skew>     fill the ledger with generated rows, untimed
+//   add <dd/mm/yyyy> <category> <amount> <type> <description>
+//   delete <id>
+//   undo
+//   category <name> | date <dd/mm/yyyy> <dd/mm/yyyy> | amount <min> <max> | keyword <text>
+//   top <n> | month <mm> <yyyy> | summary | stats
+// Ids in a stream assume replay starts from an empty ledger.
+#ifndef EXPENSE_NO_MAIN
+#define EXPENSE_NO_MAIN
+#endif
+#include "DSA_project.cpp"
+
+#include <cmath>
+#include <random>
+#include <sstream>
+
+// ============= OPERATION STREAM =============
+enum WorkloadKind {
+    OP_ADD, OP_DELETE, OP_UNDO,
+    OP_CATEGORY, OP_DATE, OP_AMOUNT, OP_KEYWORD, OP_TOP, OP_MONTH, OP_SUMMARY, OP_STATS,
+    OP_KIND_COUNT
+};
+
+static const char* const WORKLOAD_KIND_NAMES[OP_KIND_COUNT] = {
+    "add", "delete", "undo", "category", "date", "amount", "keyword", "top", "month", "summary", "stats"
+};
+
+// Text fields are views into the generator or the parsed line
+struct WorkloadOp {
+    WorkloadKind kind = OP_UNDO;
+    Transaction row{};        // add
+    int id = 0;               // delete; n for top; month for month
+    int year = 0;             // month
+    Date start{}, end{};      // date
+    double low = 0, high = 0; // amount
+    string_view text;         // category / keyword
+};
+
+bool parseWorkloadNumber(string_view s, double& value) {
+    auto res = from_chars(s.data(), s.data() + s.size(), value);
+    return res.ec == errc() && res.ptr == s.data() + s.size();
+}
+
+// Operation weights; queries are spread evenly over the eight query kinds
+struct WorkloadMix {
+    double add = 40, remove = 10, undo = 5, query = 45;
+
+    // "add=40,delete=10,undo=5,query=45"; missing keys keep their default
+    bool parse(string_view spec) {
+        while (!spec.empty()) {
+            size_t comma = spec.find(',');
+            string_view item = spec.substr(0, comma);
+            spec.remove_prefix(comma == string_view::npos ? spec.size() : comma + 1);
+            size_t eq = item.find('=');
+            if (eq == string_view::npos) return false;
+            string_view key = item.substr(0, eq);
+            double value = 0;
+            if (!parseWorkloadNumber(item.substr(eq + 1), value) || value < 0) return false;
+            if (key == "add") add = value;
+            else if (key == "delete") remove = value;
+            else if (key == "undo") undo = value;
+            else if (key == "query") query = value;
+            else return false;
+        }
+        return add + remove + undo + query > 0;
+    }
+};
+
+void writeWorkloadOp(ReportWriter& w, const WorkloadOp& op) {
+    w.text(WORKLOAD_KIND_NAMES[op.kind]);
+    switch (op.kind) {
+    case OP_ADD:
+        w.text("\t").date(op.row.date).text("\t").text(op.row.category).text("\t")
+         .number(op.row.amount, 2).text("\t").text(op.row.type).text("\t").text(op.row.description);
+        break;
+    case OP_DELETE:
+    case OP_TOP:
+        w.text("\t").integer(op.id);
+        break;
+    case OP_CATEGORY:
+    case OP_KEYWORD:
+        w.text("\t").text(op.text);
+        break;
+    case OP_DATE:
+        w.text("\t").date(op.start).text("\t").date(op.end);
+        break;
+    case OP_AMOUNT:
+        w.text("\t").number(op.low, 2).text("\t").number(op.high, 2);
+        break;
+    case OP_MONTH:
+        w.text("\t").integer(op.id).text("\t").integer(op.year);
+        break;
+    default:
+        break;
+    }
+    w.newline();
+}
+
+// Splits a line on tabs; text fields of op point into line
+bool parseWorkloadOp(string_view line, WorkloadOp& op) {
+    string_view f[6];
+    size_t n = 0;
+    while (n < 6) {
+        size_t tab = line.find('\t');
+        f[n++] = line.substr(0, tab);
+        if (tab == string_view::npos) break;
+        line.remove_prefix(tab + 1);
+    }
+    int kind = 0;
+    while (kind < OP_KIND_COUNT && f[0] != WORKLOAD_KIND_NAMES[kind]) ++kind;
+    if (kind == OP_KIND_COUNT) return false;
+    op = WorkloadOp();
+    op.kind = (WorkloadKind)kind;
+    switch (op.kind) {
+    case OP_ADD:
+        op.row.category = f[2];
+        op.row.type = f[4];
+        op.row.description = f[5];
+        return n == 6 && csvParseDate(f[1], op.row.date) && parseWorkloadNumber(f[3], op.row.amount);
+    case OP_DELETE:
+    case OP_TOP:
+        return n == 2 && csvParseInt(f[1], op.id);
+    case OP_CATEGORY:
+    case OP_KEYWORD:
+        op.text = f[1];
+        return n == 2;
+    case OP_DATE:
+        return n == 3 && csvParseDate(f[1], op.start) && csvParseDate(f[2], op.end);
+    case OP_AMOUNT:
+        return n == 3 && parseWorkloadNumber(f[1], op.low) && parseWorkloadNumber(f[2], op.high);
+    case OP_MONTH:
+        return n == 3 && csvParseInt(f[1], op.id) && csvParseInt(f[2], op.year);
+    default:
+        return n == 1;
+    }
+}
+
+// ============= GENERATOR =============
+// Categories follow a Zipf distribution (a few categories hold most rows),
+// amounts are log-normal around ₹250, dates span 2023-2025. The generator
+// mirrors the ledger's live ids, so deletes always name a live row.
+static const char* const WORKLOAD_CATEGORIES[] = {
+    "Food", "Groceries", "Transport", "Utilities", "Rent", "Shopping", "Entertainment",
+    "Health", "Dining", "Fuel", "Travel", "Education", "Insurance", "Subscriptions",
+    "Gifts", "Personal Care", "Home", "Pets", "Charity", "Taxes"
+};
+static const int WORKLOAD_CATEGORY_COUNT = sizeof(WORKLOAD_CATEGORIES) / sizeof(WORKLOAD_CATEGORIES[0]);
+
+static const char* const WORKLOAD_WORDS[] = {
+    "Lunch", "Dinner", "Uber", "Metro", "Electricity", "Water", "Movie", "Pharmacy",
+    "Books", "Coffee", "Flight", "Hotel", "Gym", "Internet", "Phone", "Groceries"
+};
+
+class WorkloadGenerator {
+private:
+    mt19937_64 rng;
+    vector<double> categoryCdf;
+    lognormal_distribution<double> amount{5.5, 1.0};
+    vector<string> descriptions;
+    WorkloadMix mix;
+
+    // Model of the ledger: live ids (swap-remove by position) and undo stack
+    vector<int> liveIds;
+    vector<size_t> livePos;
+    vector<pair<bool, int>> undoModel;      // (was add, id)
+    int nextId = 1;
+
+    double uniform() { return uniform_real_distribution<double>(0, 1)(rng); }
+
+    void markLive(int id) {
+        if (livePos.size() <= (size_t)id) livePos.resize(id + 1);
+        livePos[id] = liveIds.size();
+        liveIds.push_back(id);
+    }
+
+    void markDead(int id) {
+        size_t pos = livePos[id];
+        liveIds[pos] = liveIds.back();
+        livePos[liveIds[pos]] = pos;
+        liveIds.pop_back();
+    }
+
+    Date randomDate() {
+        return {1 + (int)(rng() % 28), 1 + (int)(rng() % 12), 2023 + (int)(rng() % 3)};
+    }
+
+public:
+    explicit WorkloadGenerator(uint64_t seed, double skew = 1.1, const WorkloadMix& m = WorkloadMix())
+        : rng(seed), mix(m) {
+        double total = 0;
+        for (int i = 0; i < WORKLOAD_CATEGORY_COUNT; ++i) {
+            total += 1.0 / pow(i + 1, skew);
+            categoryCdf.push_back(total);
+        }
+        for (double& c : categoryCdf) c /= total;
+        for (const char* word : WORKLOAD_WORDS) {
+            for (int n = 0; n < 64; ++n) descriptions.push_back(string(word) + " #" + to_string(n));
+        }
+    }
+
+    const char* category() {
+        size_t i = lower_bound(categoryCdf.begin(), categoryCdf.end(), uniform()) - categoryCdf.begin();
+        return WORKLOAD_CATEGORIES[min<size_t>(i, WORKLOAD_CATEGORY_COUNT - 1)];
+    }
+
+    // A random row; its strings point into this generator
+    Transaction row() {
+        Transaction t;
+        t.id = 0;
+        t.date = randomDate();
+        t.category = category();
+        t.amount = round(amount(rng) * 100) / 100;
+        t.description = descriptions[rng() % descriptions.size()];
+        t.type = (rng() % 10 == 0) ? "Income" : "Expense";
+        return t;
+    }
+
+    // Adds rows in batches; addTransactions() copies the strings into the ledger
+    void fill(ExpenseManager& ledger, size_t rows) {
+        const size_t BATCH = 1 << 16;
+        vector<Transaction> batch;
+        batch.reserve(min(rows, BATCH));
+        for (size_t done = 0; done < rows; done += batch.size()) {
+            batch.clear();
+            while (batch.size() < BATCH && done + batch.size() < rows) batch.push_back(row());
+            ledger.addTransactions(batch);
+        }
+        for (size_t i = 0; i < rows; ++i) markLive(nextId++);
+    }
+
+    // Advances exactly as fill() would, for a stream whose replay preloads
+    void skipFill(size_t rows) {
+        for (size_t i = 0; i < rows; ++i) {
+            row();
+            markLive(nextId++);
+        }
+    }
+
+    WorkloadOp next() {
+        WorkloadOp op;
+        double pick = uniform() * (mix.add + mix.remove + mix.undo + mix.query);
+        if (pick < mix.add || (pick < mix.add + mix.remove && liveIds.empty())) {
+            op.kind = OP_ADD;
+            op.row = row();
+            op.row.id = nextId++;
+            markLive(op.row.id);
+            undoModel.push_back({true, op.row.id});
+            return op;
+        }
+        pick -= mix.add;
+        if (pick < mix.remove) {
+            op.kind = OP_DELETE;
+            op.id = liveIds[rng() % liveIds.size()];
+            markDead(op.id);
+            undoModel.push_back({false, op.id});
+            return op;
+        }
+        pick -= mix.remove;
+        if (pick < mix.undo) {
+            op.kind = OP_UNDO;
+            if (!undoModel.empty()) {
+                if (undoModel.back().first) markDead(undoModel.back().second);
+                else markLive(undoModel.back().second);
+                undoModel.pop_back();
+            }
+            return op;
+        }
+
+        op.kind = (WorkloadKind)(OP_CATEGORY + rng() % (OP_KIND_COUNT - OP_CATEGORY));
+        switch (op.kind) {
+        case OP_CATEGORY:
+            op.text = category();
+            break;
+        case OP_DATE:
+            op.start = randomDate();
+            op.end = {min(28, op.start.day + (int)(rng() % 7)), op.start.month, op.start.year};
+            break;
+        case OP_AMOUNT:
+            op.low = round(amount(rng) * 100) / 100;
+            op.high = round(op.low * 105) / 100;
+            break;
+        case OP_KEYWORD:
+            op.text = descriptions[rng() % descriptions.size()];
+            break;
+        case OP_TOP:
+            op.id = 10;
+            break;
+        case OP_MONTH:
+            op.id = 1 + (int)(rng() % 12);
+            op.year = 2023 + (int)(rng() % 3);
+            break;
+        default:
+            break;
+        }
+        return op;
+    }
+};
+
+// ============= LATENCY RECORDER =============
+// Single-threaded histogram over the same LatencyBuckets as the core metrics
+class LatencyRecorder {
+private:
+    uint64_t counts[LatencyBuckets::COUNT] = {};
+    uint64_t total = 0;
+    uint64_t maxSeen = 0;
+
+public:
+    void record(uint64_t ns) {
+        counts[LatencyBuckets::bucketOf(ns)]++;
+        total++;
+        maxSeen = max(maxSeen, ns);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t maximum() const { return maxSeen; }
+
+    double percentile(double p) const {
+        uint64_t rank = (uint64_t)(p / 100.0 * total);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < LatencyBuckets::COUNT; ++b) {
+            seen += counts[b];
+            if (seen > rank) return (double)LatencyBuckets::lowerBound(b);
+        }
+        return 0;
+    }
+};
+
+// Report output goes through cout; the replay driver and benchmarks discard it
+class QuietOutput {
+private:
+    struct NullBuffer : streambuf {
+        int overflow(int c) override { return c; }
+        streamsize xsputn(const char*, streamsize n) override { return n; }
+    };
+    NullBuffer sink;
+    streambuf* saved;
+
+public:
+    QuietOutput() : saved(cout.rdbuf(&sink)) {}
+    ~QuietOutput() { cout.rdbuf(saved); }
+};
+
+// ============= REPLAY DRIVER =============
+struct ReplayReport {
+    LatencyRecorder latency[OP_KIND_COUNT];
+    uint64_t busyNanos[OP_KIND_COUNT] = {};
+    size_t badLines = 0;
+    size_t firstBadLine = 0;
+    double seconds = 0;
+};
+
+void runWorkloadOp(ExpenseManager& ledger, const WorkloadOp& op) {
+    switch (op.kind) {
+    case OP_ADD:
+        ledger.addTransaction(op.row.date, op.row.category, op.row.amount, op.row.description, op.row.type);
+        break;
+    case OP_DELETE:   ledger.deleteTransaction(op.id); break;
+    case OP_UNDO:     ledger.undo(); break;
+    case OP_CATEGORY: ledger.showByCategory(string(op.text)); break;
+    case OP_DATE:     ledger.searchByDateRange(op.start, op.end); break;
+    case OP_AMOUNT:   ledger.searchByAmountRange(op.low, op.high); break;
+    case OP_KEYWORD:  ledger.searchByKeyword(string(op.text)); break;
+    case OP_TOP:      ledger.showTopExpenses(op.id); break;
+    case OP_MONTH:    ledger.getMonthlyTotal(op.id, op.year, "Expense"); break;
+    case OP_SUMMARY:  ledger.showCategorySummary(); break;
+    case OP_STATS:    ledger.showStatistics(); break;
+    default: break;
+    }
+}
+
+// Runs every line of a stream against ledger, timing each operation
+void replayWorkload(istream& in, ExpenseManager& ledger, ReplayReport& report) {
+    QuietOutput quiet;
+    string line;
+    size_t lineNo = 0;
+    auto start = chrono::steady_clock::now();
+    while (getline(in, line)) {
+        ++lineNo;
+        if (line.empty() || line[0] == '#') continue;
+        if (line.compare(0, 8, "preload\t") == 0) {
+            istringstream fields(line.substr(8));
+            size_t rows = 0;
+            uint64_t seed = 0;
+            double skew = 1.1;
+            fields >> rows >> seed >> skew;
+            auto t0 = chrono::steady_clock::now();
+            WorkloadGenerator(seed, skew).fill(ledger, rows);
+            start += chrono::steady_clock::now() - t0;    // preload is not part of the run
+            continue;
+        }
+        WorkloadOp op;
+        if (!parseWorkloadOp(line, op)) {
+            if (report.badLines++ == 0) report.firstBadLine = lineNo;
+            continue;
+        }
+        auto t0 = chrono::steady_clock::now();
+        runWorkloadOp(ledger, op);
+        uint64_t ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+        report.latency[op.kind].record(ns);
+        report.busyNanos[op.kind] += ns;
+    }
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void printReplayReport(const ReplayReport& report) {
+    uint64_t total = 0;
+    for (const auto& l : report.latency) total += l.count();
+    cout << "\n" << string(86, '=') << "\n";
+    cout << "WORKLOAD REPLAY: " << total << " operations in " << fixed << setprecision(3)
+         << report.seconds << " s (" << setprecision(0) << (report.seconds > 0 ? total / report.seconds : 0)
+         << " ops/s)\n";
+    cout << string(86, '=') << "\n";
+    cout << left << setw(12) << "Operation" << right << setw(10) << "Count" << setw(14) << "Ops/s"
+         << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(13) << "p99.9 us" << setw(13) << "max us" << "\n";
+    cout << string(86, '-') << "\n";
+    for (int k = 0; k < OP_KIND_COUNT; ++k) {
+        const LatencyRecorder& l = report.latency[k];
+        if (l.count() == 0) continue;
+        double busy = report.busyNanos[k] / 1e9;
+        cout << left << setw(12) << WORKLOAD_KIND_NAMES[k] << right << setw(10) << l.count()
+             << setw(14) << setprecision(0) << (busy > 0 ? l.count() / busy : 0) << setprecision(2)
+             << setw(12) << l.percentile(50) / 1e3 << setw(12) << l.percentile(99) / 1e3
+             << setw(13) << l.percentile(99.9) / 1e3 << setw(13) << l.maximum() / 1e3 << "\n";
+    }
+    if (report.badLines > 0) {
+        cout << "✗ " << report.badLines << " unreadable lines skipped (first at line "
+             << report.firstBadLine << ")\n";
+    }
+}
+
+// ============= COMMAND LINE =============
+#ifndef EXPENSE_NO_WORKLOAD_MAIN
+int workloadUsage() {
+    cerr << "usage: expense_workload generate [--seed N] [--ops N] [--preload N] [--skew S] [--mix SPEC]\n"
+         << "       expense_workload replay <file|->\n";
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return workloadUsage();
+    string command = argv[1];
+
+    if (command == "generate") {
+        uint64_t seed = 1;
+        size_t ops = 100000, preload = 0;
+        double skew = 1.1;
+        WorkloadMix mix;
+        for (int i = 2; i + 1 < argc; i += 2) {
+            string flag = argv[i];
+            const char* value = argv[i + 1];
+            if (flag == "--seed") seed = strtoull(value, nullptr, 10);
+            else if (flag == "--ops") ops = strtoull(value, nullptr, 10);
+            else if (flag == "--preload") preload = strtoull(value, nullptr, 10);
+            else if (flag == "--skew") skew = atof(value);
+            else if (flag != "--mix" || !mix.parse(value)) return workloadUsage();
+        }
+        WorkloadGenerator gen(seed, skew, mix);
+        ReportWriter w;
+        w.text("# expense workload seed=").integer((long long)seed).text(" ops=").integer((long long)ops).newline();
+        if (preload > 0) {
+            // Replay regenerates the preload rows from the same seed
+            gen.skipFill(preload);
+            w.text("preload\t").integer((long long)preload).text("\t").integer((long long)seed)
+             .text("\t").number(skew, 3).newline();
+        }
+        for (size_t i = 0; i < ops; ++i) writeWorkloadOp(w, gen.next());
+        w.flush();
+        return 0;
+    }
+
+    if (command == "replay" && argc == 3) {
+        ExpenseManager ledger;
+        ReplayReport report;
+        string path = argv[2];
+        if (path == "-") {
+            replayWorkload(cin, ledger, report);
+        } else {
+            ifstream in(path);
+            if (!in) {
+                cout << "✗ Cannot open workload file: " << path << "\n";
+                return 1;
+            }
+            replayWorkload(in, ledger, report);
+        }
+        printReplayReport(report);
+        return 0;
+    }
+    return workloadUsage();
+}
+#endif